@@ -0,0 +1,187 @@
+#ifndef _GLOO_LUA_ARENA_H_
+#define _GLOO_LUA_ARENA_H_
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+namespace GarrysMod {
+namespace Lua {
+
+  /**
+   * @brief monotonic arena, allocations are carved out of large blocks and
+   *  only freed all at once by Release
+   *
+   * An arena is not thread safe, each thread building values should use its
+   * own arena.
+   */
+  class LuaArena
+  {
+  private:
+    std::vector<std::unique_ptr<unsigned char[]>> _blocks;
+    unsigned char                                *_cursor;
+    unsigned char                                *_end;
+    size_t                                        _block_size;
+    size_t                                        _allocated;
+  public:
+    /**
+     * @brief number of bytes handed out since the last Release
+     */
+    size_t allocated() const { return _allocated; }
+  public:
+    explicit LuaArena(size_t block_size = 64 * 1024) :
+      _cursor(nullptr),
+      _end(nullptr),
+      _block_size(block_size),
+      _allocated(0) {}
+
+    LuaArena(const LuaArena&) = delete;
+    LuaArena& operator= (const LuaArena&) = delete;
+  public:
+    /**
+     * @brief allocate memory from the current block
+     * @param size  - number of bytes
+     * @param align - alignment, power of two
+     * @return pointer to uninitialized memory
+     */
+    void* Allocate(size_t size, size_t align)
+    {
+      uintptr_t ptr = ((uintptr_t)_cursor + align - 1) & ~(uintptr_t)(align - 1);
+
+      if (!_cursor || ptr + size > (uintptr_t)_end)
+      {
+        grow(size + align);
+        ptr = ((uintptr_t)_cursor + align - 1) & ~(uintptr_t)(align - 1);
+      }
+
+      _cursor = (unsigned char*)(ptr + size);
+      _allocated += size;
+
+      return (void*)ptr;
+    }
+
+    /**
+     * @brief free every allocation at once, values allocated from the arena
+     *  must already be destroyed.  The largest block is kept for reuse.
+     */
+    void Release()
+    {
+      if (_blocks.empty())
+        return;
+
+      std::unique_ptr<unsigned char[]> last = std::move(_blocks.back());
+
+      _blocks.clear();
+      _blocks.push_back(std::move(last));
+
+      _cursor = _blocks.back().get();
+      _end = _cursor + _block_size;
+      _allocated = 0;
+    }
+
+    /**
+     * @brief arena used by values created on this thread, nullptr for the
+     *  global heap
+     */
+    static LuaArena*& Current()
+    {
+      static thread_local LuaArena *current = nullptr;
+      return current;
+    }
+  private:
+    void grow(size_t min_size)
+    {
+      // Blocks double so large trees need few of them
+      if (!_blocks.empty())
+        _block_size *= 2;
+
+      _block_size = std::max(_block_size, min_size);
+      _blocks.emplace_back(new unsigned char[_block_size]);
+
+      _cursor = _blocks.back().get();
+      _end = _cursor + _block_size;
+    }
+  }; // LuaArena
+
+  /**
+   * @brief makes arena the current arena of this thread until destroyed
+   *
+   *  LuaArena arena;
+   *  {
+   *    LuaArenaScope scope(arena);
+   *    LuaValue value = LuaValue::Pop(state, 1);
+   *  }
+   *  arena.Release();
+   */
+  class LuaArenaScope
+  {
+  private:
+    LuaArena *_previous;
+  public:
+    explicit LuaArenaScope(LuaArena &arena) : _previous(LuaArena::Current())
+    {
+      LuaArena::Current() = &arena;
+    }
+
+    ~LuaArenaScope() { LuaArena::Current() = _previous; }
+
+    LuaArenaScope(const LuaArenaScope&) = delete;
+    LuaArenaScope& operator= (const LuaArenaScope&) = delete;
+  }; // LuaArenaScope
+
+  /**
+   * @brief allocator drawing from a LuaArena, or from the global heap when
+   *  constructed without one.  A scope only affects containers explicitly
+   *  given its arena, copy construction keeps the arena of the source and
+   *  copy assignment keeps the allocator of the target.
+   */
+  template<typename T>
+  class LuaAllocator
+  {
+    template<typename U>
+    friend class LuaAllocator;
+  public:
+    typedef T value_type;
+
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::true_type  propagate_on_container_move_assignment;
+    typedef std::true_type  propagate_on_container_swap;
+  private:
+    LuaArena *_arena;
+  public:
+    LuaArena* arena() const { return _arena; }
+  public:
+    LuaAllocator() : _arena(nullptr) {}
+    explicit LuaAllocator(LuaArena *arena) : _arena(arena) {}
+
+    template<typename U>
+    LuaAllocator(const LuaAllocator<U> &that) : _arena(that._arena) {}
+  public:
+    T* allocate(size_t n)
+    {
+      if (!_arena)
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+
+      return static_cast<T*>(_arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *ptr, size_t)
+    {
+      // Arena memory is reclaimed by LuaArena::Release
+      if (!_arena)
+        ::operator delete(ptr);
+    }
+  public:
+    template<typename U>
+    bool operator==(const LuaAllocator<U> &rhs) const { return _arena == rhs._arena; }
+    template<typename U>
+    bool operator!=(const LuaAllocator<U> &rhs) const { return _arena != rhs._arena; }
+  }; // LuaAllocator
+
+}} // GarrysMod::Lua
+
+#endif//_GLOO_LUA_ARENA_H_
@@ -0,0 +1,494 @@
+#ifndef _GLOO_LUA_BINARY_H_
+#define _GLOO_LUA_BINARY_H_
+
+#include <cmath>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "LuaValue.h"
+#include "GarrysMod/Lua/Interface.h"
+
+namespace GarrysMod {
+namespace Lua {
+
+  /**
+   * @brief compact binary encoding of lua values
+   *
+   * A version byte is followed by one tagged value.  Integral numbers are
+   * zigzag varints, other numbers are 8 byte little-endian doubles, strings
+   * are a varint length followed by the raw bytes.  Tables hold a varint
+   * count of array values 1..n, those values, any other key/value pairs and
+   * an end tag.  Functions and userdata cannot be encoded.
+   */
+  class LuaBinary
+  {
+  public:
+    static const unsigned char version = 1;
+  private:
+    enum Tag : unsigned char
+    {
+      TAG_NIL,
+      TAG_FALSE,
+      TAG_TRUE,
+      TAG_INTEGER,
+      TAG_NUMBER,
+      TAG_STRING,
+      TAG_TABLE,
+      TAG_END,
+    };
+
+    struct Cursor
+    {
+      const unsigned char *pos;
+      const unsigned char *end;
+    };
+  public:
+    /**
+     * @brief encode lua value
+     * @param value  - lua value
+     * @param limits - entry limit, the one Decode will enforce
+     * @return encoded bytes
+     * @throw std::runtime_error
+     */
+    static std::string Encode(const LuaValue &value, const LuaPopLimits &limits = LuaPopLimits())
+    {
+      size_t      entries = 0;
+      std::string out(1, (char)version);
+
+      encodeValue(out, value, limits, entries);
+      return out;
+    }
+
+    /**
+     * @brief encode value on the lua stack without building a LuaValue
+     * @param state    - Lua state
+     * @param position - Lua stack position
+     * @param limits   - depth and entry limits, cycles exceed the depth limit
+     * @return encoded bytes
+     * @throw std::runtime_error
+     */
+    static std::string Encode(lua_State *state, int position, const LuaPopLimits &limits = LuaPopLimits())
+    {
+      int         top = LUA->Top();
+      size_t      entries = 0;
+      std::string out(1, (char)version);
+
+      try
+      {
+        encodeStack(state, out, position < 0 ? top + position + 1 : position, limits, entries, 0);
+      }
+      catch (...)
+      {
+        LUA->Pop(LUA->Top() - top);
+        throw;
+      }
+
+      return out;
+    }
+
+    /**
+     * @brief decode lua value
+     * @param data   - encoded bytes
+     * @param size   - number of encoded bytes
+     * @param limits - depth and entry limits
+     * @return decoded value
+     * @throw std::runtime_error
+     */
+    static LuaValue Decode(const void *data, size_t size, const LuaPopLimits &limits = LuaPopLimits())
+    {
+      Cursor   cursor = begin(data, size);
+      size_t   entries = 0;
+      LuaValue value = decodeValue(cursor, readTag(cursor), limits, entries, 0);
+
+      finish(cursor);
+      return value;
+    }
+
+    /**
+     * @brief push encoded value straight onto the lua stack, strings are
+     *  pushed from the buffer without an intermediate copy
+     * @param state  - Lua state
+     * @param data   - encoded bytes
+     * @param size   - number of encoded bytes
+     * @param limits - depth and entry limits
+     * @return number of items pushed to stack
+     * @throw std::runtime_error
+     */
+    static int Push(lua_State *state, const void *data, size_t size, const LuaPopLimits &limits = LuaPopLimits())
+    {
+      int    top = LUA->Top();
+      size_t entries = 0;
+      Cursor cursor = begin(data, size);
+
+      try
+      {
+        pushValue(state, cursor, readTag(cursor), limits, entries, 0);
+        finish(cursor);
+      }
+      catch (...)
+      {
+        LUA->Pop(LUA->Top() - top);
+        throw;
+      }
+
+      return 1;
+    }
+  private:
+    static void writeVarint(std::string &out, uint64_t value)
+    {
+      while (value >= 0x80)
+      {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+      }
+
+      out.push_back((char)value);
+    }
+
+    static void writeNumber(std::string &out, double number)
+    {
+      // Integral values in the exactly representable range become varints
+      if (number >= -9007199254740992.0 && number <= 9007199254740992.0 &&
+          number == std::floor(number) && !(number == 0 && std::signbit(number)))
+      {
+        int64_t integer = (int64_t)number;
+
+        out.push_back((char)TAG_INTEGER);
+        writeVarint(out, ((uint64_t)integer << 1) ^ (uint64_t)(integer >> 63));
+        return;
+      }
+
+      uint64_t bits;
+      std::memcpy(&bits, &number, sizeof(bits));
+
+      out.push_back((char)TAG_NUMBER);
+      for (int i = 0; i < 8; i++)
+        out.push_back((char)(bits >> (i * 8)));
+    }
+
+    static void writeString(std::string &out, const char *data, size_t size)
+    {
+      out.push_back((char)TAG_STRING);
+      writeVarint(out, size);
+      out.append(data, size);
+    }
+
+    static void encodeValue(std::string &out, const LuaValue &value, const LuaPopLimits &limits, size_t &entries)
+    {
+      switch (value.type())
+      {
+        case Type::NIL: out.push_back((char)TAG_NIL); break;
+        case Type::BOOL: out.push_back((char)((LuaValue::bool_t)value ? TAG_TRUE : TAG_FALSE)); break;
+        case Type::NUMBER: writeNumber(out, (LuaValue::number_t)value); break;
+        case Type::STRING: writeString(out, value.view().data, value.view().size); break;
+        case Type::TABLE:
+        {
+          const LuaTable &table = value.table();
+          size_t          index = 0;
+
+          checkEntries(limits, entries, table.size(), "encode");
+
+          out.push_back((char)TAG_TABLE);
+          writeVarint(out, table.array_size());
+
+          // Iteration visits the array part first and in order
+          for (const auto &pair : table)
+          {
+            if (index++ >= table.array_size())
+              encodeValue(out, pair.first, limits, entries);
+
+            encodeValue(out, pair.second, limits, entries);
+          }
+
+          out.push_back((char)TAG_END);
+          break;
+        }
+        default:
+          throw std::runtime_error("Unable to encode lua type " + std::to_string(value.type()));
+      }
+    }
+
+    static void encodeStack(lua_State *state, std::string &out, int position, const LuaPopLimits &limits, size_t &entries, size_t depth)
+    {
+      int type = LUA->GetType(position);
+
+      switch (type)
+      {
+        case Type::NIL: out.push_back((char)TAG_NIL); break;
+        case Type::BOOL: out.push_back((char)(LUA->GetBool(position) ? TAG_TRUE : TAG_FALSE)); break;
+        case Type::NUMBER: writeNumber(out, LUA->GetNumber(position)); break;
+        case Type::STRING:
+        {
+          unsigned int len = 0;
+          const char  *str = LUA->GetString(position, &len);
+
+          writeString(out, str, len);
+          break;
+        }
+        case Type::TABLE:
+        {
+          if (depth >= limits.max_depth)
+            throw std::runtime_error("Unable to encode table nested deeper than " + std::to_string(limits.max_depth));
+
+          // The border ObjLen reports can lie far past the entries of a
+          // sparse table, so the array part is the non-nil prefix only
+          double count = 0;
+
+          for (;; count++)
+          {
+            LUA->PushNumber(count + 1);
+            LUA->RawGet(position);
+
+            bool nil = LUA->GetType(-1) == Type::NIL;
+            LUA->Pop();
+
+            if (nil)
+              break;
+
+            checkEntries(limits, entries, 1, "encode");
+          }
+
+          out.push_back((char)TAG_TABLE);
+          writeVarint(out, (uint64_t)count);
+
+          for (double i = 1; i <= count; i++)
+          {
+            LUA->PushNumber(i);
+            LUA->RawGet(position);
+            encodeStack(state, out, LUA->Top(), limits, entries, depth + 1);
+            LUA->Pop();
+          }
+
+          // Remaining pairs
+          LUA->PushNil();
+          while (LUA->Next(position))
+          {
+            int key = LUA->Top() - 1;
+
+            if (LUA->GetType(key) == Type::NUMBER)
+            {
+              double number = LUA->GetNumber(key);
+
+              if (number >= 1 && number <= count && number == std::floor(number))
+              {
+                LUA->Pop();
+                continue;
+              }
+            }
+
+            checkEntries(limits, entries, 1, "encode");
+
+            encodeStack(state, out, key, limits, entries, depth + 1);
+            encodeStack(state, out, key + 1, limits, entries, depth + 1);
+            LUA->Pop();
+          }
+
+          out.push_back((char)TAG_END);
+          break;
+        }
+        default:
+          throw std::runtime_error("Unable to encode lua type '" + std::string(LUA->GetTypeName(type)) + "'");
+      }
+    }
+
+    static Cursor begin(const void *data, size_t size)
+    {
+      Cursor cursor = { (const unsigned char*)data, (const unsigned char*)data + size };
+
+      if (size == 0 || *cursor.pos != version)
+        throw std::runtime_error("Unable to decode lua value, unknown format version");
+
+      cursor.pos++;
+      return cursor;
+    }
+
+    static void finish(const Cursor &cursor)
+    {
+      if (cursor.pos != cursor.end)
+        throw std::runtime_error("Unable to decode lua value, trailing data");
+    }
+
+    static void require(const Cursor &cursor, size_t len)
+    {
+      if ((size_t)(cursor.end - cursor.pos) < len)
+        throw std::runtime_error("Unable to decode lua value, truncated data");
+    }
+
+    static Tag readTag(Cursor &cursor)
+    {
+      require(cursor, 1);
+      return (Tag)*cursor.pos++;
+    }
+
+    static uint64_t readVarint(Cursor &cursor)
+    {
+      uint64_t value = 0;
+
+      for (int shift = 0; shift < 64; shift += 7)
+      {
+        require(cursor, 1);
+
+        unsigned char byte = *cursor.pos++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+          return value;
+      }
+
+      throw std::runtime_error("Unable to decode lua value, malformed varint");
+    }
+
+    static double readNumber(Cursor &cursor, Tag tag)
+    {
+      if (tag == TAG_INTEGER)
+      {
+        uint64_t zigzag = readVarint(cursor);
+        return (double)(int64_t)((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+      }
+
+      uint64_t bits = 0;
+      double   number;
+
+      require(cursor, 8);
+      for (int i = 0; i < 8; i++)
+        bits |= (uint64_t)*cursor.pos++ << (i * 8);
+
+      std::memcpy(&number, &bits, sizeof(number));
+      return number;
+    }
+
+    static LuaStringView readString(Cursor &cursor)
+    {
+      uint64_t size = readVarint(cursor);
+
+      require(cursor, (size_t)size);
+
+      LuaStringView str((const char*)cursor.pos, (size_t)size);
+      cursor.pos += size;
+
+      return str;
+    }
+
+    static void checkDepth(const LuaPopLimits &limits, size_t depth)
+    {
+      if (depth >= limits.max_depth)
+        throw std::runtime_error("Unable to decode table nested deeper than " + std::to_string(limits.max_depth));
+    }
+
+    static void checkEntries(const LuaPopLimits &limits, size_t &entries, uint64_t count, const char *action = "decode")
+    {
+      if (count > limits.max_entries - entries)
+        throw std::runtime_error(std::string("Unable to ") + action + " table with more than " + std::to_string(limits.max_entries) + " entries");
+
+      entries += (size_t)count;
+    }
+
+    static void checkKey(Tag tag, double number)
+    {
+      // Lua rejects NaN keys just like nil keys
+      if (tag == TAG_NIL || (tag == TAG_NUMBER && std::isnan(number)))
+        throw std::runtime_error("Unable to decode lua value, nil or NaN table key");
+    }
+
+    static LuaValue decodeValue(Cursor &cursor, Tag tag, const LuaPopLimits &limits, size_t &entries, size_t depth)
+    {
+      switch (tag)
+      {
+        case TAG_NIL: return LuaValue();
+        case TAG_FALSE: return LuaValue(false);
+        case TAG_TRUE: return LuaValue(true);
+        case TAG_INTEGER:
+        case TAG_NUMBER: return LuaValue(readNumber(cursor, tag));
+        case TAG_STRING: return LuaValue(readString(cursor).str());
+        case TAG_TABLE:
+        {
+          checkDepth(limits, depth);
+
+          uint64_t count = readVarint(cursor);
+          LuaTable table(LuaArena::Current());
+
+          // Every array value takes at least one byte
+          require(cursor, (size_t)count);
+          checkEntries(limits, entries, count);
+          table.Reserve((size_t)count, 0);
+
+          for (uint64_t i = 1; i <= count; i++)
+          {
+            LuaValue value = decodeValue(cursor, readTag(cursor), limits, entries, depth + 1);
+
+            if (value.type() != Type::NIL)
+              table.Emplace(LuaValue((LuaValue::number_t)i), std::move(value));
+          }
+
+          for (Tag key; (key = readTag(cursor)) != TAG_END;)
+          {
+            checkEntries(limits, entries, 1);
+
+            LuaValue key_value = decodeValue(cursor, key, limits, entries, depth + 1);
+            checkKey(key, key_value.type() == Type::NUMBER ? (double)key_value : 0);
+
+            table.Emplace(std::move(key_value), decodeValue(cursor, readTag(cursor), limits, entries, depth + 1));
+          }
+
+          return LuaValue(std::move(table));
+        }
+        default:
+          throw std::runtime_error("Unable to decode lua value, unknown tag");
+      }
+    }
+
+    static void pushValue(lua_State *state, Cursor &cursor, Tag tag, const LuaPopLimits &limits, size_t &entries, size_t depth)
+    {
+      switch (tag)
+      {
+        case TAG_NIL: LUA->PushNil(); break;
+        case TAG_FALSE: LUA->PushBool(false); break;
+        case TAG_TRUE: LUA->PushBool(true); break;
+        case TAG_INTEGER:
+        case TAG_NUMBER: LUA->PushNumber(readNumber(cursor, tag)); break;
+        case TAG_STRING: LuaValue::PushString(state, readString(cursor)); break;
+        case TAG_TABLE:
+        {
+          checkDepth(limits, depth);
+
+          uint64_t count = readVarint(cursor);
+
+          require(cursor, (size_t)count);
+          checkEntries(limits, entries, count);
+          LUA->CreateTable();
+
+          for (uint64_t i = 1; i <= count; i++)
+          {
+            LUA->PushNumber((double)i);
+            pushValue(state, cursor, readTag(cursor), limits, entries, depth + 1);
+
+            // Holes are skipped
+            if (LUA->GetType(-1) == Type::NIL)
+              LUA->Pop(2);
+            else
+              LUA->RawSet(-3);
+          }
+
+          for (Tag key; (key = readTag(cursor)) != TAG_END;)
+          {
+            checkEntries(limits, entries, 1);
+
+            pushValue(state, cursor, key, limits, entries, depth + 1);
+            checkKey(key, key == TAG_NUMBER ? LUA->GetNumber(-1) : 0);
+
+            pushValue(state, cursor, readTag(cursor), limits, entries, depth + 1);
+            LUA->RawSet(-3);
+          }
+
+          break;
+        }
+        default:
+          throw std::runtime_error("Unable to decode lua value, unknown tag");
+      }
+    }
+  }; // LuaBinary
+
+}} // GarrysMod::Lua
+
+#endif//_GLOO_LUA_BINARY_H_
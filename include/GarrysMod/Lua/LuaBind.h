@@ -0,0 +1,210 @@
+#ifndef _GLOO_LUA_BIND_H_
+#define _GLOO_LUA_BIND_H_
+
+#include <string>
+#include <cstddef>
+#include <type_traits>
+#include "LuaValue.h"
+#include "GarrysMod/Lua/Interface.h"
+
+namespace GarrysMod {
+namespace Lua {
+
+  /**
+   * @brief reads and pushes C++ values directly from/to the lua stack, types
+   *  without a specialization are converted through LuaValue
+   */
+  template<typename T, typename Enable = void>
+  struct LuaStack
+  {
+    static T Check(lua_State *state, int position) { return LuaValue::Pop(state, position); }
+    static int Push(lua_State *state, const T &value) { return LuaValue(value).Push(state); }
+  };
+
+  template<>
+  struct LuaStack<bool>
+  {
+    static bool Check(lua_State *state, int position)
+    {
+      LUA->CheckType(position, Type::BOOL);
+      return LUA->GetBool(position);
+    }
+
+    static int Push(lua_State *state, bool value) { LUA->PushBool(value); return 1; }
+  };
+
+  template<typename T>
+  struct LuaStack<T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type>
+  {
+    static T Check(lua_State *state, int position) { return (T)LUA->CheckNumber(position); }
+    static int Push(lua_State *state, T value) { LUA->PushNumber((double)value); return 1; }
+  };
+
+  template<>
+  struct LuaStack<std::string>
+  {
+    static std::string Check(lua_State *state, int position)
+    {
+      unsigned int len = 0;
+
+      LUA->CheckType(position, Type::STRING);
+      const char *value = LUA->GetString(position, &len);
+
+      return std::string(value, len);
+    }
+
+    static int Push(lua_State *state, const std::string &value)
+    {
+      LuaValue::PushString(state, value);
+      return 1;
+    }
+  };
+
+  template<>
+  struct LuaStack<LuaStringView>
+  {
+    static LuaStringView Check(lua_State *state, int position)
+    {
+      unsigned int len = 0;
+
+      LUA->CheckType(position, Type::STRING);
+      const char *value = LUA->GetString(position, &len);
+
+      return LuaStringView(value, len);
+    }
+
+    static int Push(lua_State *state, LuaStringView value)
+    {
+      LuaValue::PushString(state, value);
+      return 1;
+    }
+  };
+
+  template<>
+  struct LuaStack<const char*>
+  {
+    static const char* Check(lua_State *state, int position) { return LUA->CheckString(position); }
+    static int Push(lua_State *state, const char *value) { LUA->PushString(value); return 1; }
+  };
+
+  template<>
+  struct LuaStack<LuaValue>
+  {
+    static LuaValue Check(lua_State *state, int position) { return LuaValue::Pop(state, position); }
+    static int Push(lua_State *state, const LuaValue &value) { return value.Push(state); }
+  };
+
+  template<size_t... I>
+  struct LuaIndices {};
+
+  template<size_t N, size_t... I>
+  struct LuaMakeIndices : LuaMakeIndices<N - 1, N - 1, I...> {};
+
+  template<size_t... I>
+  struct LuaMakeIndices<0, I...> { typedef LuaIndices<I...> type; };
+
+  template<typename R>
+  struct LuaBindResult
+  {
+    template<typename F>
+    static int Call(lua_State *state, F fn) { return LuaStack<typename std::decay<R>::type>::Push(state, fn()); }
+  };
+
+  template<>
+  struct LuaBindResult<void>
+  {
+    template<typename F>
+    static int Call(lua_State *state, F fn) { fn(); return 0; }
+  };
+
+  /**
+   * @brief generates lua_CFunctions calling fn, arguments are read straight
+   *  from the lua stack and the result is pushed without LuaValue boxing.
+   *  Member functions are called on T::Borrow, so methods inherited from a
+   *  base class accept instances of T.  Use the GLOO_METHOD, GLOO_GETTER and
+   *  GLOO_SETTER macros to deduce F.
+   */
+  template<typename T, typename F, F fn>
+  struct LuaBind;
+
+  template<typename T, typename C, typename R, typename... Args, R (C::*fn)(Args...)>
+  struct LuaBind<T, R (C::*)(Args...), fn>
+  {
+    static_assert(std::is_base_of<C, T>::value, "bound method must belong to the object class or a base of it");
+
+    /**
+     * @brief obj:method(args...)
+     */
+    static int Method(lua_State *state) { return call<2>(state, typename LuaMakeIndices<sizeof...(Args)>::type()); }
+
+    /**
+     * @brief obj.name, registered with AddGetter
+     */
+    static int Getter(lua_State *state) { return call<3>(state, typename LuaMakeIndices<sizeof...(Args)>::type()); }
+
+    /**
+     * @brief obj.name = value, registered with AddSetter
+     */
+    static int Setter(lua_State *state) { return call<3>(state, typename LuaMakeIndices<sizeof...(Args)>::type()); }
+  private:
+    template<int Offset, size_t... I>
+    static int call(lua_State *state, LuaIndices<I...>)
+    {
+      C *obj = T::Borrow(state, 1);
+
+      return LuaBindResult<R>::Call(state, [&]() -> R {
+        return (obj->*fn)(LuaStack<typename std::decay<Args>::type>::Check(state, Offset + (int)I)...);
+      });
+    }
+  };
+
+  template<typename T, typename C, typename R, typename... Args, R (C::*fn)(Args...) const>
+  struct LuaBind<T, R (C::*)(Args...) const, fn>
+  {
+    static_assert(std::is_base_of<C, T>::value, "bound method must belong to the object class or a base of it");
+
+    static int Method(lua_State *state) { return call<2>(state, typename LuaMakeIndices<sizeof...(Args)>::type()); }
+    static int Getter(lua_State *state) { return call<3>(state, typename LuaMakeIndices<sizeof...(Args)>::type()); }
+    static int Setter(lua_State *state) { return call<3>(state, typename LuaMakeIndices<sizeof...(Args)>::type()); }
+  private:
+    template<int Offset, size_t... I>
+    static int call(lua_State *state, LuaIndices<I...>)
+    {
+      const C *obj = T::Borrow(state, 1);
+
+      return LuaBindResult<R>::Call(state, [&]() -> R {
+        return (obj->*fn)(LuaStack<typename std::decay<Args>::type>::Check(state, Offset + (int)I)...);
+      });
+    }
+  };
+
+  template<typename R, typename... Args, R (*fn)(Args...)>
+  struct LuaBind<void, R (*)(Args...), fn>
+  {
+    /**
+     * @brief function(args...), arguments start at stack position 1
+     */
+    static int Function(lua_State *state) { return call(state, typename LuaMakeIndices<sizeof...(Args)>::type()); }
+  private:
+    template<size_t... I>
+    static int call(lua_State *state, LuaIndices<I...>)
+    {
+      return LuaBindResult<R>::Call(state, [&]() -> R {
+        return fn(LuaStack<typename std::decay<Args>::type>::Check(state, 1 + (int)I)...);
+      });
+    }
+  }; // LuaBind
+
+}} // GarrysMod::Lua
+
+/**
+ * @brief bind member function of an object class as method, getter or
+ *  setter, the member may be inherited from a base class
+ *  cls.AddMethod("name", GLOO_METHOD(Object, method));
+ */
+#define GLOO_METHOD(type, name) (::GarrysMod::Lua::LuaBind<type, decltype(&type::name), &type::name>::Method)
+#define GLOO_GETTER(type, name) (::GarrysMod::Lua::LuaBind<type, decltype(&type::name), &type::name>::Getter)
+#define GLOO_SETTER(type, name) (::GarrysMod::Lua::LuaBind<type, decltype(&type::name), &type::name>::Setter)
+#define GLOO_FUNCTION(fn) (::GarrysMod::Lua::LuaBind<void, decltype(fn), fn>::Function)
+
+#endif//_GLOO_LUA_BIND_H_
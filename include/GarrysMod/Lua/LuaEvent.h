@@ -1,31 +1,172 @@
 #ifndef _GLOO_LUA_EVENT_H_
 #define _GLOO_LUA_EVENT_H_
 
-#include <set>
-#include <deque>
+#include <map>
 #include <tuple>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <memory>
 #include <sstream>
 #include <algorithm>
+#include <unordered_map>
 #include "LuaValue.h"
 #include "LuaObject.h"
+#include "LuaEventId.h"
+#include "LuaEventArgs.h"
+#include "LuaEventQueue.h"
+#include "LuaEventPolicy.h"
+#include "LuaEventListeners.h"
 #include "GarrysMod/Lua/Interface.h"
 
 namespace GarrysMod {
 namespace Lua {
 
+  class ILuaEventEmitter;
+
+  /**
+   * @brief lock-free list of emitters with pending events, signalled from any
+   *  thread and drained by LuaEventEmitterManager on the lua thread
+   */
+  class LuaEventReadyList
+  {
+  public:
+    struct Node
+    {
+      std::atomic<LuaEventReadyList*>  list;    // set while registered with a manager
+      std::atomic<bool>                queued;  // node is linked into list
+      Node                            *next;
+      std::weak_ptr<ILuaEventEmitter>  emitter; // lua thread only
+      size_t                           slot;    // lua thread only
+
+      Node() : list(nullptr), queued(false), next(nullptr), slot(0) {}
+    };
+  private:
+    std::atomic<Node*> _head;
+  public:
+    LuaEventReadyList() : _head(nullptr) {}
+  public:
+    /**
+     * @brief link node into the list it is registered with, unless it is
+     *  already linked or not registered
+     * @param node - emitter node
+     */
+    static void Signal(Node &node)
+    {
+      // Pairs with the fence in Take so either the consumer sees the new
+      // event or this sees the cleared flag
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      LuaEventReadyList *list = node.list.load(std::memory_order_acquire);
+
+      if (!list || node.queued.load(std::memory_order_relaxed) || node.queued.exchange(true, std::memory_order_acq_rel))
+        return;
+
+      Node *head = list->_head.load(std::memory_order_relaxed);
+
+      do
+        node.next = head;
+      while (!list->_head.compare_exchange_weak(head, &node, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief unlink every node in signal order, each node must be passed to
+     *  Take before its emitter is drained
+     * @return first node
+     */
+    Node* TakeAll()
+    {
+      Node *node = _head.exchange(nullptr, std::memory_order_acquire);
+      Node *ordered = nullptr;
+
+      // Reverse so emitters are visited in the order they were signalled
+      while (node)
+      {
+        Node *next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+      }
+
+      return ordered;
+    }
+
+    /**
+     * @brief allow node to be signalled again
+     * @param node - node returned by TakeAll
+     * @return next node
+     */
+    static Node* Take(Node *node)
+    {
+      Node *next = node->next;
+
+      // Release so the producer relinking the node sees next no longer used
+      node->queued.store(false, std::memory_order_release);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      return next;
+    }
+  }; // LuaEventReadyList
+
   class ILuaEventEmitter
   {
+    friend class LuaEventEmitterManager;
+  private:
+    std::shared_ptr<LuaEventReadyList::Node> _ready_node;
   public:
-    virtual void Think(lua_State *state) = 0;
+    ILuaEventEmitter() : _ready_node(std::make_shared<LuaEventReadyList::Node>()) {}
+
+    // Signal so the manager notices the emitter is gone and frees its slot
+    virtual ~ILuaEventEmitter() { signalReady(); }
+  protected:
+    /**
+     * @brief mark emitter as having pending events, safe from any thread
+     */
+    void signalReady() { LuaEventReadyList::Signal(*_ready_node); }
+  public:
+    /**
+     * @brief dispatch queued events up to the emitter's own limit
+     * @param state - lua state
+     * @return true if events remain queued
+     */
+    virtual bool Think(lua_State *state) = 0;
+
+    /**
+     * @brief dispatch queued events until either limit is reached
+     * @param state      - lua state
+     * @param max_events - maximum number of events to dispatch
+     * @param deadline   - point in time after which no further events are dispatched
+     * @return true if events remain queued
+     */
+    virtual bool Think(lua_State *state, int max_events, std::chrono::steady_clock::time_point deadline) = 0;
+
+    /**
+     * @brief deliver work Think deferred to the end of the tick, called by
+     *  the manager once per tick after a budgeted Think
+     * @param state - lua state
+     */
+    virtual void Flush(lua_State *state) {}
   }; // ILuaEventEmitter
 
   class LuaEventEmitterManager
   {
   private:
-    std::set<std::weak_ptr<ILuaEventEmitter>> _emitters;
+    typedef LuaEventReadyList::Node node_t;
+  private:
+    // Registered emitters, indexed by node slot
+    std::vector<std::shared_ptr<node_t>> _slots;
+    std::vector<size_t> _free_slots;
+    size_t _registered;
+    LuaEventReadyList _ready;
+    // Emitters taken off the ready list this tick, kept in members so a lua
+    // error unwinding out of Think leaves them to be re-signalled next tick
+    std::vector<node_t*> _taken;
+    size_t _taken_pos;
+    std::vector<std::pair<std::shared_ptr<ILuaEventEmitter>, node_t*>> _pending;
+    // Every emitter visited by a budgeted tick, flushed once at its end
+    std::vector<std::pair<std::shared_ptr<ILuaEventEmitter>, node_t*>> _flush;
+    std::unordered_map<uint32_t, std::string> _event_names;
     std::string _hook_name()
     {
       std::ostringstream ss;
@@ -34,44 +175,264 @@ namespace Lua {
       return ss.str();
     }
     bool _hooked;
+    size_t _think_offset;
+    std::chrono::microseconds _think_budget;
+  private:
+    // Events dispatched by one emitter before yielding to the next when budgeted
+    static const int think_quantum = 16;
+  public:
+    LuaEventEmitterManager() :
+      _registered(0),
+      _taken_pos(0),
+      _hooked(false),
+      _think_offset(0),
+      _think_budget(0)
+    {}
+  public:
+    /**
+     * @brief get wall-clock time shared by all emitters each tick, zero when
+     *  emitters are limited by max_events_per_tick instead
+     */
+    std::chrono::microseconds think_budget() const { return _think_budget; }
+
+    /**
+     * @brief set wall-clock time shared by all emitters each tick, events are
+     *  drained round-robin until the budget runs out.  Zero restores the
+     *  per-emitter max_events_per_tick limit.
+     * @param value - budget per tick
+     */
+    void think_budget(std::chrono::microseconds value) { _think_budget = value; }
   public:
     /**
-     * @brief called every tick
+     * @brief number of registered emitters
+     */
+    size_t registered() const { return _registered; }
+  public:
+    /**
+     * @brief called every tick, only emitters signalled by Emit are visited
      * @param state - lua state
      */
     void Think(lua_State *state)
     {
-      // Begin iteration of emitters
-      for (auto iter = _emitters.begin(); iter != _emitters.end();)
+      if (_think_budget.count() > 0)
       {
-        // Attempt to get shared_ptr
-        if (auto emitter = iter->lock())
-        {
-          emitter->Think(state);
-          ++iter;
-        }
-        else
-          // Shared_ptr not accessable, remove from set
-          iter = _emitters.erase(iter);
+        thinkBudgeted(state);
+        return;
+      }
+
+      takeReady();
+
+      // The position only advances once an emitter returned, so one that
+      // raised a lua error is re-signalled along with the rest
+      while (_taken_pos < _taken.size())
+      {
+        node_t *current = _taken[_taken_pos];
+        auto emitter = current->emitter.lock();
+
+        if (!emitter)
+          releaseNode(current);
+        // Events left over by max_events_per_tick wait for the next tick
+        else if (emitter->Think(state))
+          LuaEventReadyList::Signal(*current);
+
+        _taken_pos++;
       }
 
       // If zero emitters stored, remove Think hook
-      if (_emitters.size() == 0)
+      if (_registered == 0)
         resetThink(state);
     }
 
     /**
-     * @brief inserts emitter weak_ptr to stored set and hooks Think if not
-     *  already hooked
+     * @brief check if emitter is registered with this manager or none
+     * @param emitter - emitter to check
+     */
+    bool Accepts(const ILuaEventEmitter &emitter) const
+    {
+      auto list = emitter._ready_node->list.load(std::memory_order_relaxed);
+      return !list || list == &_ready;
+    }
+
+    /**
+     * @brief register emitter so its events are dispatched and hook Think
+     *  if not already hooked, registering twice has no effect.  An emitter
+     *  belongs to a single lua state, registering it with the manager of
+     *  another state raises a lua error.
      * @param state - lua state
      * @param emitter - emitter to store
      */
-    void RegisterEmitter(lua_State *state, std::weak_ptr<ILuaEventEmitter> emitter)
+    void RegisterEmitter(lua_State *state, const std::shared_ptr<ILuaEventEmitter> &emitter)
     {
-      _emitters.insert(emitter);
+      auto &node = emitter->_ready_node;
+
+      if (node->list.load(std::memory_order_relaxed) == &_ready)
+        return;
+
+      if (!Accepts(*emitter))
+        LUA->ThrowError("event emitter is already registered with another lua state");
+
+      if (_free_slots.empty())
+      {
+        node->slot = _slots.size();
+        _slots.push_back(node);
+      }
+      else
+      {
+        node->slot = _free_slots.back();
+        _free_slots.pop_back();
+        _slots[node->slot] = node;
+      }
+
+      node->emitter = emitter;
+      node->list.store(&_ready, std::memory_order_release);
+      _registered++;
+
+      // Events emitted before registration were not signalled
+      LuaEventReadyList::Signal(*node);
+
       hookThink(state);
     }
+
+    /**
+     * @brief intern event name used by lua, raises a lua error if the name
+     *  hashes to the same identifier as a different interned name
+     * @param state - lua state
+     * @param name  - event name
+     * @param len   - length of name
+     * @return event identifier
+     */
+    LuaEventId Intern(lua_State *state, const char *name, size_t len)
+    {
+      auto id = LuaEventId::Make(name, len);
+      auto iter = _event_names.find(id.value());
+
+      if (iter == _event_names.end())
+        _event_names.emplace(id.value(), std::string(name, len));
+      else if (iter->second.size() != len || iter->second.compare(0, len, name, len) != 0)
+        LUA->ThrowError(("Event name '" + std::string(name, len) + "' collides with '" + iter->second + "'").c_str());
+
+      return id;
+    }
+
+    /**
+     * @brief get interned name for event identifier
+     * @param id - event identifier
+     * @return event name, empty if the identifier was never interned
+     */
+    std::string EventName(LuaEventId id) const
+    {
+      auto iter = _event_names.find(id.value());
+      return iter == _event_names.end() ? std::string() : iter->second;
+    }
   private:
+    void thinkBudgeted(lua_State *state)
+    {
+      auto deadline = std::chrono::steady_clock::now() + _think_budget;
+
+      takeReady();
+
+      // Collect signalled emitters, releasing expired ones
+      for (; _taken_pos < _taken.size(); _taken_pos++)
+      {
+        node_t *current = _taken[_taken_pos];
+
+        if (auto emitter = current->emitter.lock())
+          _pending.emplace_back(std::move(emitter), current);
+        else
+          releaseNode(current);
+      }
+
+      _flush = _pending;
+
+      // Rotate starting emitter so an exhausted budget doesn't always
+      // starve the same emitters
+      if (!_pending.empty())
+      {
+        _think_offset = (_think_offset + 1) % _pending.size();
+        std::rotate(_pending.begin(), _pending.begin() + _think_offset, _pending.end());
+      }
+
+      // Round-robin a quantum of events from each emitter until every queue
+      // is drained or the budget runs out
+      while (!_pending.empty() && std::chrono::steady_clock::now() < deadline)
+      {
+        for (size_t i = 0; i < _pending.size() && std::chrono::steady_clock::now() < deadline;)
+        {
+          if (_pending[i].first->Think(state, think_quantum, deadline))
+            i++;
+          else
+            _pending.erase(_pending.begin() + i);
+        }
+      }
+
+      // Batch listeners see one call per tick however many quanta ran
+      for (auto &flush : _flush)
+        flush.first->Flush(state);
+
+      _flush.clear();
+
+      // Emitters the budget ran out on continue next tick
+      for (auto &pending : _pending)
+        LuaEventReadyList::Signal(*pending.second);
+
+      _pending.clear();
+
+      // If zero emitters stored, remove Think hook
+      if (_registered == 0)
+        resetThink(state);
+    }
+
+    /**
+     * @brief unlink every signalled emitter into _taken, first re-signalling
+     *  emitters a lua error left unvisited on the previous tick
+     */
+    void takeReady()
+    {
+      for (size_t i = _taken_pos; i < _taken.size(); i++)
+        LuaEventReadyList::Signal(*_taken[i]);
+
+      for (auto &pending : _pending)
+        LuaEventReadyList::Signal(*pending.second);
+
+      for (auto &flush : _flush)
+        LuaEventReadyList::Signal(*flush.second);
+
+      _taken.clear();
+      _taken_pos = 0;
+      _pending.clear();
+      _flush.clear();
+
+      // Every node is allowed to be signalled again before any emitter runs
+      for (node_t *node = _ready.TakeAll(); node;)
+      {
+        _taken.push_back(node);
+        node = LuaEventReadyList::Take(node);
+      }
+    }
+
+    /**
+     * @brief free slot of an emitter that no longer exists
+     */
+    void releaseNode(node_t *node)
+    {
+      // The emitter destructor may still be about to signal, wait until it
+      // dropped its reference so the node is never freed while linked
+      if (_slots[node->slot].use_count() > 1)
+      {
+        LuaEventReadyList::Signal(*node);
+        return;
+      }
+
+      size_t slot = node->slot;
+
+      node->list.store(nullptr, std::memory_order_relaxed);
+      _free_slots.push_back(slot);
+      _registered--;
+
+      // Last reference, node is destroyed
+      _slots[slot].reset();
+    }
+
     void hookThink(lua_State *state)
     {
       if (_hooked)
@@ -122,13 +483,54 @@ namespace Lua {
   , public ILuaEventEmitter
   {
   private:
-    std::map<std::string, std::vector<std::tuple<bool, int>>> _listeners;
-    std::mutex _listeners_mtx;
-    std::deque<std::tuple<std::string, std::vector<LuaValue>>> _events;
-    std::mutex _events_mtx;
+    // Event, arguments and policy state of events with a policy
+    typedef std::tuple<LuaEventId, LuaEventArgs, LuaEventPolicyState*> event_t;
+    typedef LuaEventIdMap<LuaEventPolicyState*> policies_t;
+    typedef LuaEventQueue<event_t> queue_t;
+  public:
+    static const int lane_count = 3;
+  private:
+    LuaEventListeners _listeners;
+    // One queue per LuaEventPriority, each allocated on its first Emit so
+    // emitters that never emit cost no ring
+    std::atomic<queue_t*> _lanes[lane_count];
+    size_t _lane_capacity;
+    // All zero drains lanes in strict priority order
+    int _lane_weights[lane_count];
+    int _lane_cursor;
+    int _lane_credit;
+    // Immutable policy table read by Emit, replaced wholesale by SetEventPolicy.
+    // Producers count themselves in the reader count of the current epoch
+    // while they use a table.  Think retires replaced tables and states by
+    // advancing the epoch, frees them once the previous epoch has no readers
+    // left, and frees states only after their queued events are dispatched.
+    std::atomic<const policies_t*> _policies;
+    std::atomic<uint32_t> _policy_epoch;
+    mutable std::atomic<uint32_t> _policy_readers[2];
+    std::atomic<bool> _policies_retired;
+    std::mutex _policies_mtx;
+    std::unique_ptr<policies_t> _policy_table;
+    std::vector<std::unique_ptr<LuaEventPolicyState>> _policy_states;
+    // Replaced since the last epoch change
+    std::vector<std::unique_ptr<policies_t>> _retired_tables;
+    std::vector<std::unique_ptr<LuaEventPolicyState>> _retired_states;
+    // Waiting for the readers of _grace_epoch to leave
+    std::vector<std::unique_ptr<policies_t>> _grace_tables;
+    std::vector<std::unique_ptr<LuaEventPolicyState>> _grace_states;
+    uint32_t _grace_epoch;
+    // Unreachable by producers, waiting for their queued events
+    std::vector<std::unique_ptr<LuaEventPolicyState>> _draining_states;
+    // Batch tables built during Think and not yet flushed: event, registry
+    // reference to the table, event count
+    std::vector<std::tuple<LuaEventId, int, int>> _batches;
   private:
     int _max_events_per_tick;
   protected:
+    /**
+     * @brief get maximum number of events that can be queued before Emit drops them
+     */
+    size_t max_queued_events() { return queue_t::Capacity(_lane_capacity); }
+
     /**
      * @brief get maximum number of events to process for each Think call
      */
@@ -138,86 +540,273 @@ namespace Lua {
      * @brief set maximum number of events to process for each Think call
      */
     void max_events_per_tick(int value) { _max_events_per_tick = value; }
+
+    /**
+     * @brief set how many events each lane may dispatch before the next lane
+     *  gets its turn, weights below one are raised to one.  Passing all zero
+     *  restores strict priority, where lower lanes only run once higher ones
+     *  are empty.
+     */
+    void lane_weights(int high, int normal, int low)
+    {
+      bool strict = high <= 0 && normal <= 0 && low <= 0;
+
+      _lane_weights[(int)LuaEventPriority::HIGH] = strict ? 0 : std::max(high, 1);
+      _lane_weights[(int)LuaEventPriority::NORMAL] = strict ? 0 : std::max(normal, 1);
+      _lane_weights[(int)LuaEventPriority::LOW] = strict ? 0 : std::max(low, 1);
+      _lane_cursor = 0;
+      _lane_credit = _lane_weights[0];
+    }
   public:
-    LuaEventEmitter() :
+    /**
+     * @param max_queued_events - capacity of each priority lane, rounded up to a power of two
+     */
+    LuaEventEmitter(size_t max_queued_events = 128) :
       LuaObject<TType, TChildObject>(),
+      _lane_capacity(max_queued_events),
+      _lane_weights(),
+      _lane_cursor(0),
+      _lane_credit(0),
+      _policies(nullptr),
+      _policy_epoch(0),
+      _policies_retired(false),
+      _grace_epoch(0),
       _max_events_per_tick(100)
     {
-      LuaObject<TType, TChildObject>::AddMethod("on", on);
-      LuaObject<TType, TChildObject>::AddMethod("once", once);
-      LuaObject<TType, TChildObject>::AddMethod("add_listener", add_listener);
-      LuaObject<TType, TChildObject>::AddMethod("remove_listeners", remove_listeners);
+      for (auto &lane : _lanes)
+        lane.store(nullptr, std::memory_order_relaxed);
+
+      for (auto &readers : _policy_readers)
+        readers.store(0, std::memory_order_relaxed);
+    }
+
+    ~LuaEventEmitter()
+    {
+      for (auto &lane : _lanes)
+        delete lane.load(std::memory_order_relaxed);
+    }
+  public:
+    /**
+     * @brief define LuaObject metamethods and listener methods
+     * @param cls - class definition
+     */
+    static void Define(LuaObjectClass &cls)
+    {
+      LuaObject<TType, TChildObject>::Define(cls);
+
+      cls.AddMethod("on", on);
+      cls.AddMethod("once", once);
+      cls.AddMethod("on_batch", on_batch);
+      cls.AddMethod("add_listener", add_listener);
+      cls.AddMethod("off", off);
+      cls.AddMethod("remove_listeners", remove_listeners);
     }
   public:
     /**
-     * @brief enqueue event with supplied arguments
-     * @param name - event name
-     * @param args - event args
+     * @brief enqueue event with supplied arguments, never blocks
+     * @param id   - event identifier, strings convert implicitly and
+     *  "name"_event is hashed at compile time
+     * @param args - event args, numbers, booleans and strings are stored
+     *  inline in the queued event without allocating
+     * @return DROPPED if the event queue is full or the event's policy
+     *  rejected it, see LuaEventStatus
+     */
+    template<typename... Args>
+    LuaEventStatus Emit(LuaEventId id, Args&&... args)
+    {
+      return Emit(LuaEventPriority::NORMAL, id, std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief enqueue event in the lane of priority, never blocks
+     * @param priority - lane to queue the event in, ignored for events with
+     *  a policy which are queued in the lane of the policy
+     * @param id       - event identifier
+     * @param args     - event args
+     * @return DROPPED if the lane is full or the event's policy rejected it
      */
     template<typename... Args>
-    void Emit(std::string name, Args ...args)
+    LuaEventStatus Emit(LuaEventPriority priority, LuaEventId id, Args&&... args)
     {
-      std::unique_lock<std::mutex> lock(_events_mtx);
+      event_t event;
+
+      std::get<0>(event) = id;
+      std::get<1>(event).Append(std::forward<Args>(args)...);
 
-      std::vector<LuaValue> argv = { LuaValue(args)... };
+      // Emitters without any policy never touch the reader count
+      if (!_policies.load(std::memory_order_acquire))
+        return emitUnpolicied(priority, event);
 
-      _events.push_back(
-        std::make_tuple(name, argv)
-      );
+      PolicyReader reader(*this);
+      LuaEventPolicyState *const *policy = reader.policies->Find(id);
+
+      if (!policy)
+        return emitUnpolicied(priority, event);
+
+      // Policy accounting assumes events of one name are popped in the order
+      // they were queued, which only holds within a single lane
+      queue_t &events = lane((*policy)->policy().priority);
+
+      std::get<2>(event) = *policy;
+
+      LuaEventStatus status = (*policy)->Emit(std::get<1>(event), [&events, &event]()
+      {
+        return events.Push(std::move(event));
+      });
+
+      if (status == LuaEventStatus::QUEUED || status == LuaEventStatus::REPLACED_OLDEST)
+        this->signalReady();
+
+      return status;
     }
 
     /**
-     * @param called via LuaEventEmitterManager
+     * @brief set the queueing policy of an event, safe to call from any thread.
+     *  Events already queued keep the policy they were emitted with, the
+     *  replaced policy is freed by a later Think once they are dispatched.
+     * @param id     - event identifier
+     * @param policy - policy to apply to events emitted from now on
+     * @throw std::runtime_error if policy sets a capacity for a mode without one
+     */
+    void SetEventPolicy(LuaEventId id, const LuaEventPolicy &policy)
+    {
+      std::unique_ptr<LuaEventPolicyState> state(new LuaEventPolicyState(id, policy));
+      std::unique_lock<std::mutex> lock(_policies_mtx);
+
+      std::unique_ptr<policies_t> table(_policy_table ? new policies_t(*_policy_table) : new policies_t());
+      LuaEventPolicyState *&slot = (*table)[id];
+
+      // Retire the state this one replaces
+      for (auto iter = _policy_states.begin(); slot && iter != _policy_states.end(); ++iter)
+      {
+        if (iter->get() != slot)
+          continue;
+
+        _retired_states.push_back(std::move(*iter));
+        _policy_states.erase(iter);
+        break;
+      }
+
+      slot = state.get();
+      _policy_states.push_back(std::move(state));
+
+      _policies.store(table.get(), std::memory_order_seq_cst);
+
+      if (_policy_table)
+        _retired_tables.push_back(std::move(_policy_table));
+
+      _policy_table = std::move(table);
+      _policies_retired.store(true, std::memory_order_release);
+
+      // Make sure a Think runs to free what was retired
+      this->signalReady();
+    }
+
+    /**
+     * @brief number of pending events of an event with a policy, 0 otherwise
+     * @param id - event identifier
+     */
+    size_t PendingEvents(LuaEventId id) const
+    {
+      if (!_policies.load(std::memory_order_acquire))
+        return 0;
+
+      PolicyReader reader(*this);
+      LuaEventPolicyState *const *policy = reader.policies->Find(id);
+
+      return policy ? (*policy)->pending() : 0;
+    }
+
+    /**
+     * @brief called via LuaEventEmitterManager after Emit signalled it
      * @param state - lua state
+     * @return true if events remain queued
      */
-    void Think(lua_State *state) override
+    bool Think(lua_State *state) override
     {
-      std::unique_lock<std::mutex> events_lock(_events_mtx);
+      bool more = Think(state, _max_events_per_tick, std::chrono::steady_clock::time_point::max());
 
-      if (_events.empty())
-        return;
+      Flush(state);
+      return more;
+    }
+
+    /**
+     * @brief invoke batch listeners with every batch built since the last flush
+     * @param state - lua state
+     */
+    void Flush(lua_State *state) override
+    {
+      if (!_batches.empty())
+        flushBatches(state);
+    }
+
+    /**
+     * @brief called via LuaEventEmitterManager when a think budget is set
+     * @param state      - lua state
+     * @param max_events - maximum number of events to dispatch
+     * @param deadline   - point in time after which no further events are dispatched
+     * @return true if events remain queued
+     */
+    bool Think(lua_State *state, int max_events, std::chrono::steady_clock::time_point deadline) override
+    {
+      event_t event;
+      bool timed = deadline != std::chrono::steady_clock::time_point::max();
+      // Listeners added or removed by callbacks publish a new snapshot, the
+      // one held here stays valid until it is refreshed between events
+      std::shared_ptr<const LuaEventListeners::Snapshot> snapshot;
+
+      if (_policies_retired.load(std::memory_order_acquire))
+        reclaimPolicies();
+
+      if (!pending())
+        return false;
       
       // Limited event iteration
-      for (int i = 0; i < std::min((int)_events.size(), _max_events_per_tick); i++)
+      for (int i = 0; i < max_events && popEvent(event); i++)
       {
-        // Pop first event
-        auto event = _events.front();
-        auto name = std::get<0>(event);
-        auto args = std::get<1>(event);
-        _events.pop_front();
+        auto &args = std::get<1>(event);
+
+        // Superseded by a newer event of a drop-oldest policy
+        if (std::get<2>(event) && !std::get<2>(event)->Take(args))
+          continue;
+
+        auto &listeners = _listeners.Acquire(snapshot);
 
-        // Lock listeners vector
-        std::unique_lock<std::mutex> listeners_lock(_listeners_mtx);
+        if (listeners.batch_listeners.size() != 0 && listeners.batch_listeners.Find(std::get<0>(event)))
+          appendBatch(state, std::get<0>(event), args);
+
+        // Skip events nobody listens to
+        auto list = listeners.listeners.Find(std::get<0>(event));
+        if (!list)
+          continue;
 
         // Iterate listeners
-        std::vector<std::tuple<bool, int>> &listeners = _listeners[name];
-        for (auto iter = listeners.begin(); iter != listeners.end();)
+        for (auto &listener : **list)
         {
-          auto argc = 0;
-          auto once = std::get<0>(*iter);
-          auto ref = std::get<1>(*iter);
+          // Removed by an earlier callback
+          if (listener->removed.load(std::memory_order_relaxed))
+            continue;
 
           // Push reference to callback
-          LUA->ReferencePush(ref);
-
-          // Push args and increment argc
-          for (auto &arg : args)
-            argc += arg.Push(state);
-          
-          // Invoke callback with args count
-          LUA->Call(argc, 0);
-
-          // Remove if once bit is set
-          if (once)
-            iter = listeners.erase(iter);
-          else
-            ++iter;
+          LUA->ReferencePush(listener->ref);
+
+          // Remove before calling so a nested Think cannot invoke it twice
+          if (listener->once)
+            _listeners.Remove(state, listener->handle);
+
+          // Push args and invoke callback with args count
+          LUA->Call(args.Push(state), 0);
         }
+
+        if (timed && std::chrono::steady_clock::now() >= deadline)
+          break;
       }
+
+      return pending();
     }
 
     /**
-     * @brief clears listeners vector and unrefs all supplied listeners
+     * @brief removes every listener and unrefs all supplied callbacks
      * @param state - lua state
      */
     void Destroy(lua_State *state) override
@@ -225,49 +814,311 @@ namespace Lua {
       removeListeners(state);
     }
   private:
-    void addListener(lua_State *state, std::string name, int fn_ref, bool once)
+    /**
+     * @brief keeps the policy table it loaded alive while in scope
+     */
+    struct PolicyReader
     {
-      std::unique_lock<std::mutex> lock(_listeners_mtx);
+      const LuaEventEmitter &emitter;
+      const policies_t      *policies;
+      uint32_t               epoch;
 
-      // Store listener
-      _listeners[name].push_back(std::make_tuple(once, fn_ref));
+      PolicyReader(const LuaEventEmitter &emitter) : emitter(emitter)
+      {
+        // Counted in an epoch that is still current once counted, so every
+        // table retired before the next epoch change is visible to Think
+        for (;;)
+        {
+          epoch = emitter._policy_epoch.load(std::memory_order_seq_cst);
+          emitter._policy_readers[epoch & 1].fetch_add(1, std::memory_order_seq_cst);
 
-      // Register this in event emitter manager
-      LuaEventEmitterManager::Current(state)
-        .RegisterEmitter(
-          state,
-          this->shared_from_this()
-        );
+          if (emitter._policy_epoch.load(std::memory_order_seq_cst) == epoch)
+            break;
+
+          emitter._policy_readers[epoch & 1].fetch_sub(1, std::memory_order_release);
+        }
+
+        policies = emitter._policies.load(std::memory_order_seq_cst);
+      }
+
+      ~PolicyReader() { emitter._policy_readers[epoch & 1].fetch_sub(1, std::memory_order_release); }
+    };
+
+    LuaEventStatus emitUnpolicied(LuaEventPriority priority, event_t &event)
+    {
+      if (!lane(priority).Push(std::move(event)))
+        return LuaEventStatus::DROPPED;
+
+      this->signalReady();
+      return LuaEventStatus::QUEUED;
     }
 
-    void removeListeners(lua_State *state)
+    /**
+     * @brief free retired policy tables and states nothing refers to any
+     *  more, consumer thread only since popped events still use their state
+     */
+    void reclaimPolicies()
+    {
+      std::unique_lock<std::mutex> lock(_policies_mtx, std::try_to_lock);
+
+      if (!lock.owns_lock())
+      {
+        this->signalReady();
+        return;
+      }
+
+      // Readers counting themselves from now on load the current table
+      if (_grace_tables.empty() && _grace_states.empty() && (!_retired_tables.empty() || !_retired_states.empty()))
+      {
+        _grace_epoch = _policy_epoch.fetch_add(1, std::memory_order_seq_cst);
+        _grace_tables.swap(_retired_tables);
+        _grace_states.swap(_retired_states);
+      }
+
+      if (_policy_readers[_grace_epoch & 1].load(std::memory_order_seq_cst) == 0)
+      {
+        _grace_tables.clear();
+
+        for (auto &state : _grace_states)
+          _draining_states.push_back(std::move(state));
+
+        _grace_states.clear();
+      }
+
+      auto idle = std::remove_if(_draining_states.begin(), _draining_states.end(), [](const std::unique_ptr<LuaEventPolicyState> &state)
+      {
+        return state->idle();
+      });
+
+      _draining_states.erase(idle, _draining_states.end());
+
+      // Anything left is retried next tick
+      if (_retired_tables.empty() && _retired_states.empty() && _grace_tables.empty() && _grace_states.empty() && _draining_states.empty())
+        _policies_retired.store(false, std::memory_order_relaxed);
+      else
+        this->signalReady();
+    }
+
+    /**
+     * @brief queue of a priority lane, allocating it on first use
+     */
+    queue_t& lane(LuaEventPriority priority)
+    {
+      auto &slot = _lanes[(int)priority];
+      queue_t *queue = slot.load(std::memory_order_acquire);
+
+      if (!queue)
+      {
+        std::unique_ptr<queue_t> created(new queue_t(_lane_capacity));
+
+        // Another producer may have installed the lane first
+        if (slot.compare_exchange_strong(queue, created.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+          queue = created.release();
+      }
+
+      return *queue;
+    }
+
+    /**
+     * @brief check if any lane holds a published event, consumer thread only
+     */
+    bool pending() const
+    {
+      for (auto &lane : _lanes)
+      {
+        const queue_t *queue = lane.load(std::memory_order_acquire);
+
+        if (queue && !queue->Empty())
+          return true;
+      }
+
+      return false;
+    }
+
+    /**
+     * @brief pop the next event by strict priority or lane weights
+     * @param event - receives popped event
+     * @return false when every lane is empty
+     */
+    bool popEvent(event_t &event)
+    {
+      if (_lane_weights[0] == 0)
+      {
+        for (auto &lane : _lanes)
+        {
+          queue_t *queue = lane.load(std::memory_order_acquire);
+
+          if (queue && queue->Pop(event))
+            return true;
+        }
+
+        return false;
+      }
+
+      // Visit the current lane then each lane once more with fresh credit
+      for (int tried = 0; tried <= lane_count; tried++)
+      {
+        queue_t *queue = _lanes[_lane_cursor].load(std::memory_order_acquire);
+
+        if (_lane_credit > 0 && queue && queue->Pop(event))
+        {
+          _lane_credit--;
+          return true;
+        }
+
+        _lane_cursor = (_lane_cursor + 1) % lane_count;
+        _lane_credit = _lane_weights[_lane_cursor];
+      }
+
+      return false;
+    }
+
+    /**
+     * @brief append event arguments as a tuple to the batch table of its
+     *  event, creating the batch table on first use this tick
+     */
+    void appendBatch(lua_State *state, LuaEventId id, const LuaEventArgs &args)
+    {
+      std::tuple<LuaEventId, int, int> *batch = nullptr;
+
+      // Few distinct events are batched per tick, a linear scan is enough
+      for (auto &entry : _batches)
+        if (std::get<0>(entry) == id)
+          batch = &entry;
+
+      // Batch tables live in the registry so they survive budgeted quanta
+      // and lua errors until flushed
+      if (!batch)
+      {
+        LUA->CreateTable();
+        _batches.emplace_back(id, LUA->ReferenceCreate(), 0);
+        batch = &_batches.back();
+      }
+
+      LUA->ReferencePush(std::get<1>(*batch));
+      int table = LUA->Top();
+
+      // Build { ..., n = count } from pushed args
+      LUA->CreateTable();
+      int tuple = LUA->Top();
+      int count = args.Push(state);
+
+      for (int i = count; i > 0; i--)
+      {
+        LUA->PushNumber(i);
+        LUA->Insert(-2);
+        LUA->RawSet(tuple);
+      }
+
+      LUA->PushNumber(count);
+      LUA->SetField(tuple, "n");
+
+      LUA->PushNumber(++std::get<2>(*batch));
+      LUA->Insert(-2);
+      LUA->RawSet(table);
+      LUA->Pop(1);
+    }
+
+    /**
+     * @brief invoke batch listeners once with every batch built this tick
+     */
+    void flushBatches(lua_State *state)
     {
-      std::unique_lock<std::mutex> lock(_listeners_mtx);
+      std::shared_ptr<const LuaEventListeners::Snapshot> snapshot;
 
-      for (auto &listeners : _listeners)
+      while (!_batches.empty())
       {
-        for (auto &listener : listeners.second)
+        // Unlink the batch before calling into lua, a listener error then
+        // loses at most this batch instead of delivering it twice
+        auto batch = _batches.front();
+        _batches.erase(_batches.begin());
+
+        LUA->ReferencePush(std::get<1>(batch));
+        LUA->ReferenceFree(std::get<1>(batch));
+        int table = LUA->Top();
+
+        auto list = _listeners.Acquire(snapshot).batch_listeners.Find(std::get<0>(batch));
+
+        for (size_t i = 0; list && i < (*list)->size(); i++)
         {
-          LUA->ReferenceFree(std::get<1>(listener));
+          auto &listener = (**list)[i];
+
+          if (listener->removed.load(std::memory_order_relaxed))
+            continue;
+
+          LUA->ReferencePush(listener->ref);
+
+          if (listener->once)
+            _listeners.Remove(state, listener->handle);
+
+          LUA->Push(table);
+          LUA->Call(1, 0);
         }
+
+        LUA->Pop(1);
+      }
+    }
+
+    void freeBatches(lua_State *state)
+    {
+      for (auto &batch : _batches)
+        LUA->ReferenceFree(std::get<1>(batch));
+
+      _batches.clear();
+    }
+
+    uint64_t addListener(lua_State *state, LuaEventId id, int fn_ref, bool once, bool batch = false)
+    {
+      auto &manager = LuaEventEmitterManager::Current(state);
+
+      if (!manager.Accepts(*this))
+      {
+        LUA->ReferenceFree(fn_ref);
+        LUA->ThrowError("event emitter is already registered with another lua state");
+      }
+
+      // Store listener
+      uint64_t handle = _listeners.Add(id, fn_ref, once, batch);
+
+      if (!handle)
+      {
+        LUA->ReferenceFree(fn_ref);
+        LUA->ThrowError("too many listeners");
       }
 
-      _listeners.clear();
+      // Register this in event emitter manager
+      manager.RegisterEmitter(state, this->shared_from_this());
+
+      return handle;
+    }
+
+    void removeListeners(lua_State *state)
+    {
+      _listeners.Clear(state);
+      freeBatches(state);
     }
   private:
+    static LuaEventId checkEventId(lua_State *state, int position)
+    {
+      unsigned int len = 0;
+      const char *name = LUA->GetString(position, &len);
+
+      return LuaEventEmitterManager::Current(state).Intern(state, name, len);
+    }
+
     static int on(lua_State *state)
     {
       LUA->CheckType(2, Type::STRING);
       LUA->CheckType(3, Type::FUNCTION);
 
-      auto obj = LuaObject<TType, TChildObject>::Pop(state, 1);
-      auto name = LuaValue::Pop(state, 2);
+      auto obj = LuaObject<TType, TChildObject>::Borrow(state, 1);
+      auto id = checkEventId(state, 2);
 
       LUA->Push(3);
       int fn_ref = LUA->ReferenceCreate();
 
-      obj->addListener(state, name, fn_ref, false);
-      return 0;
+      LUA->PushNumber((double)obj->addListener(state, id, fn_ref, false));
+      return 1;
     }
 
     static int once(lua_State *state)
@@ -275,14 +1126,29 @@ namespace Lua {
       LUA->CheckType(2, Type::STRING);
       LUA->CheckType(3, Type::FUNCTION);
 
-      auto obj = LuaObject<TType, TChildObject>::Pop(state, 1);
-      auto name = LuaValue::Pop(state, 2);
+      auto obj = LuaObject<TType, TChildObject>::Borrow(state, 1);
+      auto id = checkEventId(state, 2);
 
       LUA->Push(3);
       int fn_ref = LUA->ReferenceCreate();
 
-      obj->addListener(state, name, fn_ref, true);
-      return 0;
+      LUA->PushNumber((double)obj->addListener(state, id, fn_ref, true));
+      return 1;
+    }
+
+    static int on_batch(lua_State *state)
+    {
+      LUA->CheckType(2, Type::STRING);
+      LUA->CheckType(3, Type::FUNCTION);
+
+      auto obj = LuaObject<TType, TChildObject>::Borrow(state, 1);
+      auto id = checkEventId(state, 2);
+
+      LUA->Push(3);
+      int fn_ref = LUA->ReferenceCreate();
+
+      LUA->PushNumber((double)obj->addListener(state, id, fn_ref, false, true));
+      return 1;
     }
 
     static int add_listener(lua_State *state)
@@ -290,8 +1156,8 @@ namespace Lua {
       LUA->CheckType(2, Type::STRING);
       LUA->CheckType(3, Type::FUNCTION);
 
-      auto obj = LuaObject<TType, TChildObject>::Pop(state, 1);
-      auto name = LuaValue::Pop(state, 2);
+      auto obj = LuaObject<TType, TChildObject>::Borrow(state, 1);
+      auto id = checkEventId(state, 2);
       auto once = false;
 
       LUA->Push(3);
@@ -300,37 +1166,31 @@ namespace Lua {
       if (LUA->IsType(4, Type::BOOL))
         once = LUA->GetBool(4);
 
-      obj->addListener(state, name, fn_ref, once);
-      return 0;
+      LUA->PushNumber((double)obj->addListener(state, id, fn_ref, once));
+      return 1;
+    }
+
+    static int off(lua_State *state)
+    {
+      LUA->CheckType(2, Type::NUMBER);
+
+      auto obj = LuaObject<TType, TChildObject>::Borrow(state, 1);
+      double handle = LUA->GetNumber(2);
+
+      // Handles are exact integers below 2^53
+      bool valid = handle >= 0 && handle < 9007199254740992.0;
+
+      LUA->PushBool(valid && obj->_listeners.Remove(state, (uint64_t)handle));
+      return 1;
     }
 
     static int remove_listeners(lua_State *state)
     {
-      LuaObject<TType, TChildObject>::Pop(state, 1)->removeListeners(state);
+      LuaObject<TType, TChildObject>::Borrow(state, 1)->removeListeners(state);
       return 0;
     }
   }; // LuaEventEmitter
 
-  /**
-   * @brief lt operator implementation for ILuaEventEmitter weak_ptr to allow weak_ptr in set
-   * @param lhs - left hand side
-   * @param rhs - right hand side
-   * @return lhs < rhs
-   */
-  bool operator < (const std::weak_ptr<ILuaEventEmitter>& lhs, const std::weak_ptr<ILuaEventEmitter>& rhs)
-  {
-    auto lhs_shared = lhs.lock();
-    auto rhs_shared = rhs.lock();
-
-    if (!lhs_shared & !rhs_shared)
-      return false;
-    
-    if (!lhs_shared) return false;
-    if (!rhs_shared) return true;
-
-    return lhs_shared < rhs_shared;
-  }
-
 }} // GarrysMod::Lua
 
 #endif//_GLOO_LUA_EVENT_H_
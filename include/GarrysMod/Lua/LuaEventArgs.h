@@ -0,0 +1,278 @@
+#ifndef _GLOO_LUA_EVENT_ARGS_H_
+#define _GLOO_LUA_EVENT_ARGS_H_
+
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include "LuaValue.h"
+#include "GarrysMod/Lua/Interface.h"
+
+namespace GarrysMod {
+namespace Lua {
+
+  /**
+   * @brief type-erased event arguments stored in a fixed-size inline buffer
+   *
+   * Arguments are written as a tagged byte stream and pushed straight onto the
+   * lua stack.  Numbers, booleans and strings that fit in the inline buffer
+   * never touch the heap, larger payloads spill into a single heap block and
+   * tables fall back to an owned LuaValue.
+   */
+  class LuaEventArgs
+  {
+  public:
+    static const size_t inline_size = 64;
+  private:
+    enum Tag : unsigned char
+    {
+      TAG_NIL,
+      TAG_FALSE,
+      TAG_TRUE,
+      TAG_NUMBER,
+      TAG_STRING,
+      TAG_FUNCTION,
+      TAG_USERDATA,
+      TAG_VALUE,
+    };
+  private:
+    unsigned char                    _inline[inline_size];
+    std::unique_ptr<unsigned char[]> _spill;
+    uint32_t                         _size;
+    uint32_t                         _capacity;
+    uint32_t                         _count;
+  public:
+    /**
+     * @brief number of arguments
+     */
+    size_t count() const { return _count; }
+
+    /**
+     * @brief check if arguments spilled out of the inline buffer
+     */
+    bool spilled() const { return (bool)_spill; }
+  public:
+    LuaEventArgs() : _size(0), _capacity(inline_size), _count(0) {}
+    LuaEventArgs(LuaEventArgs &&that) : LuaEventArgs() { Move(that); }
+    ~LuaEventArgs() { Clear(); }
+
+    LuaEventArgs(const LuaEventArgs&) = delete;
+    LuaEventArgs& operator= (const LuaEventArgs&) = delete;
+  public:
+    /**
+     * @brief take ownership of that's arguments, leaving that empty
+     * @param that - event arguments
+     */
+    void Move(LuaEventArgs &that)
+    {
+      if (this == &that)
+        return;
+
+      Clear();
+
+      if (that._spill)
+        _spill = std::move(that._spill);
+      else
+        std::memcpy(_inline, that._inline, that._size);
+
+      _size = that._size;
+      _capacity = that._capacity;
+      _count = that._count;
+
+      that._size = 0;
+      that._capacity = inline_size;
+      that._count = 0;
+    }
+
+    /**
+     * @brief destroy stored arguments
+     */
+    void Clear()
+    {
+      const unsigned char *iter = data();
+      const unsigned char *end = iter + _size;
+
+      // Release owned LuaValue fallbacks
+      while (iter < end)
+      {
+        if (*iter == TAG_VALUE)
+          delete read<LuaValue*>(iter + 1);
+
+        iter = next(iter);
+      }
+
+      _spill.reset();
+      _size = 0;
+      _capacity = inline_size;
+      _count = 0;
+    }
+
+    /**
+     * @brief append arguments in order
+     * @param args - arguments
+     */
+    template<typename T, typename... Rest>
+    void Append(T &&arg, Rest&&... rest)
+    {
+      Add(std::forward<T>(arg));
+      Append(std::forward<Rest>(rest)...);
+    }
+    void Append() {}
+
+    void Add(std::nullptr_t) { writeTag(TAG_NIL); }
+    void Add(bool value) { writeTag(value ? TAG_TRUE : TAG_FALSE); }
+    void Add(CFunc value) { writeTag(TAG_FUNCTION, value); }
+    void Add(void *value) { writeTag(TAG_USERDATA, value); }
+    void Add(const char *value) { Add(value, std::strlen(value)); }
+    void Add(const std::string &value) { Add(value.data(), value.size()); }
+    void Add(LuaStringView value) { Add(value.data, value.size); }
+
+    template<typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type Add(T value)
+    {
+      writeTag(TAG_NUMBER, (double)value);
+    }
+
+    /**
+     * @brief append binary-safe string argument
+     * @param value - string data
+     * @param len   - length of string data
+     */
+    void Add(const char *value, size_t len)
+    {
+      uint32_t size = (uint32_t)len;
+      unsigned char *out = reserve(1 + sizeof(size) + len + 1);
+
+      *out = TAG_STRING;
+      std::memcpy(out + 1, &size, sizeof(size));
+      std::memcpy(out + 1 + sizeof(size), value, len);
+      // Terminate so PushString never sees a zero length without a NUL
+      out[1 + sizeof(size) + len] = '\0';
+
+      _count++;
+    }
+
+    /**
+     * @brief append LuaValue argument, simple types are stored inline
+     * @param value - lua value
+     */
+    void Add(const LuaValue &value)
+    {
+      switch (value.type())
+      {
+        case Type::NIL: Add(nullptr); break;
+        case Type::BOOL: Add((LuaValue::bool_t)value); break;
+        case Type::NUMBER: Add((LuaValue::number_t)value); break;
+        case Type::STRING: Add(value.view().data, value.view().size); break;
+        case Type::FUNCTION: Add((LuaValue::function_t)value); break;
+        default: writeTag(TAG_VALUE, new LuaValue(value)); break;
+      }
+    }
+
+    /**
+     * @brief push arguments to lua stack
+     * @param state - lua state
+     * @return number of items pushed to stack
+     */
+    int Push(lua_State *state) const
+    {
+      int                  argc = 0;
+      const unsigned char *iter = data();
+      const unsigned char *end = iter + _size;
+
+      while (iter < end)
+      {
+        switch (*iter)
+        {
+          case TAG_NIL: LUA->PushNil(); break;
+          case TAG_FALSE: LUA->PushBool(false); break;
+          case TAG_TRUE: LUA->PushBool(true); break;
+          case TAG_NUMBER: LUA->PushNumber(read<double>(iter + 1)); break;
+          case TAG_STRING:
+            LuaValue::PushString(state, LuaStringView((const char*)iter + 1 + sizeof(uint32_t), read<uint32_t>(iter + 1)));
+            break;
+          case TAG_FUNCTION: LUA->PushCFunction(read<CFunc>(iter + 1)); break;
+          case TAG_USERDATA: LUA->PushUserdata(read<void*>(iter + 1)); break;
+          case TAG_VALUE: read<LuaValue*>(iter + 1)->Push(state); break;
+        }
+
+        argc++;
+        iter = next(iter);
+      }
+
+      return argc;
+    }
+  public:
+    inline LuaEventArgs& operator= (LuaEventArgs &&rhs)
+    {
+      Move(rhs);
+      return *this;
+    }
+  private:
+    const unsigned char* data() const { return _spill ? _spill.get() : _inline; }
+
+    template<typename T>
+    static T read(const unsigned char *src)
+    {
+      T value;
+      std::memcpy(&value, src, sizeof(T));
+      return value;
+    }
+
+    static const unsigned char* next(const unsigned char *iter)
+    {
+      switch (*iter)
+      {
+        case TAG_NUMBER: return iter + 1 + sizeof(double);
+        case TAG_STRING: return iter + 1 + sizeof(uint32_t) + read<uint32_t>(iter + 1) + 1;
+        case TAG_FUNCTION: return iter + 1 + sizeof(CFunc);
+        case TAG_USERDATA: return iter + 1 + sizeof(void*);
+        case TAG_VALUE: return iter + 1 + sizeof(LuaValue*);
+        default: return iter + 1;
+      }
+    }
+
+    void writeTag(Tag tag)
+    {
+      *reserve(1) = tag;
+      _count++;
+    }
+
+    template<typename T>
+    void writeTag(Tag tag, T value)
+    {
+      unsigned char *out = reserve(1 + sizeof(T));
+
+      *out = tag;
+      std::memcpy(out + 1, &value, sizeof(T));
+
+      _count++;
+    }
+
+    unsigned char* reserve(size_t len)
+    {
+      if (_size + len > _capacity)
+      {
+        // Spill to heap, stored LuaValue pointers are moved bytewise
+        size_t capacity = std::max<size_t>(_capacity * 2, _size + len);
+        std::unique_ptr<unsigned char[]> spill(new unsigned char[capacity]);
+
+        std::memcpy(spill.get(), data(), _size);
+
+        _spill = std::move(spill);
+        _capacity = (uint32_t)capacity;
+      }
+
+      unsigned char *out = (_spill ? _spill.get() : _inline) + _size;
+      _size += (uint32_t)len;
+
+      return out;
+    }
+  }; // LuaEventArgs
+
+}} // GarrysMod::Lua
+
+#endif//_GLOO_LUA_EVENT_ARGS_H_
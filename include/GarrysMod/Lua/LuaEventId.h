@@ -0,0 +1,228 @@
+#ifndef _GLOO_LUA_EVENT_ID_H_
+#define _GLOO_LUA_EVENT_ID_H_
+
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <unordered_map>
+
+namespace GarrysMod {
+namespace Lua {
+
+  /**
+   * @brief integer event identifier, a 32-bit FNV-1a hash of the event name
+   *
+   * "name"_event is hashed at compile time, runtime strings hash to the same
+   * value so names registered from lua and emitted from C++ agree.  Debug
+   * builds check names created through Make against each other.
+   */
+  class LuaEventId
+  {
+  private:
+    uint32_t _value;
+  private:
+    static constexpr uint32_t fnv1a(const char *str, size_t len, uint32_t hash)
+    {
+      return len == 0 ? hash : fnv1a(str + 1, len - 1, (hash ^ (unsigned char)*str) * 16777619u);
+    }
+
+    // Zero is reserved for empty LuaEventIdMap slots
+    static constexpr uint32_t nonzero(uint32_t hash) { return hash == 0 ? 1 : hash; }
+  public:
+    constexpr uint32_t value() const { return _value; }
+  public:
+    constexpr LuaEventId() : _value(0) {}
+    constexpr LuaEventId(const char *name, size_t len) :
+      _value(nonzero(fnv1a(name, len, 2166136261u))) {}
+
+    LuaEventId(const char *name) : _value(Hash(name, std::strlen(name))) {}
+    LuaEventId(const std::string &name) : _value(Hash(name.data(), name.size())) {}
+  public:
+    /**
+     * @brief hash runtime string without recursion
+     * @param name - event name
+     * @param len  - length of name
+     * @return event identifier value
+     */
+    static uint32_t Hash(const char *name, size_t len)
+    {
+      uint32_t hash = 2166136261u;
+
+      for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+
+      return nonzero(hash);
+    }
+
+    /**
+     * @brief create event identifier from runtime string, meant for intern
+     *  time rather than Emit as debug builds check it for collisions
+     * @param name - event name
+     * @param len  - length of name
+     */
+    static LuaEventId Make(const char *name, size_t len)
+    {
+      LuaEventId id;
+      id._value = Hash(name, len);
+
+#ifndef NDEBUG
+      checkName(id._value, name, len);
+#endif
+
+      return id;
+    }
+  private:
+#ifndef NDEBUG
+    // Names interned from lua go through Make as well, so this also catches
+    // a C++ name colliding with a lua one
+    static void checkName(uint32_t hash, const char *name, size_t len)
+    {
+      static std::mutex mtx;
+      static std::unordered_map<uint32_t, std::string> names;
+
+      std::unique_lock<std::mutex> lock(mtx);
+      auto iter = names.find(hash);
+
+      if (iter == names.end())
+        names.emplace(hash, std::string(name, len));
+      else
+        assert(iter->second.size() == len && iter->second.compare(0, len, name, len) == 0 && "event names collide");
+    }
+#endif
+  public:
+    constexpr bool operator==(const LuaEventId &rhs) const { return _value == rhs._value; }
+    constexpr bool operator!=(const LuaEventId &rhs) const { return _value != rhs._value; }
+    constexpr bool operator< (const LuaEventId &rhs) const { return _value < rhs._value; }
+  }; // LuaEventId
+
+  /**
+   * @brief compile-time event identifier literal, "name"_event
+   */
+  constexpr LuaEventId operator"" _event(const char *name, size_t len)
+  {
+    return LuaEventId(name, len);
+  }
+
+  /**
+   * @brief open-addressing map keyed by LuaEventId
+   *
+   * Identifiers are already well mixed hashes so they index the slot array
+   * directly, lookups are a mask and usually a single compare.
+   */
+  template<typename T>
+  class LuaEventIdMap
+  {
+  private:
+    std::vector<std::pair<uint32_t, T>> _slots;
+    size_t                              _size;
+  public:
+    size_t size() const { return _size; }
+  public:
+    LuaEventIdMap() : _slots(8), _size(0) {}
+  public:
+    /**
+     * @brief find value stored for identifier
+     * @param id - event identifier
+     * @return pointer to value or nullptr when absent
+     */
+    const T* Find(LuaEventId id) const
+    {
+      size_t mask = _slots.size() - 1;
+
+      for (size_t i = id.value() & mask;; i = (i + 1) & mask)
+      {
+        if (_slots[i].first == id.value())
+          return &_slots[i].second;
+        if (_slots[i].first == 0)
+          return nullptr;
+      }
+    }
+
+    T* Find(LuaEventId id)
+    {
+      return const_cast<T*>(static_cast<const LuaEventIdMap*>(this)->Find(id));
+    }
+
+    /**
+     * @brief find or default insert value for identifier
+     * @param id - event identifier
+     * @return reference to stored value
+     */
+    T& operator[](LuaEventId id)
+    {
+      if (T *value = Find(id))
+        return *value;
+
+      // Keep load factor at or below one half
+      if ((_size + 1) * 2 > _slots.size())
+        grow();
+
+      size_t mask = _slots.size() - 1;
+      size_t i = id.value() & mask;
+
+      while (_slots[i].first != 0)
+        i = (i + 1) & mask;
+
+      _size++;
+      _slots[i].first = id.value();
+      return _slots[i].second;
+    }
+
+    /**
+     * @brief invoke fn(id, value) for every stored value
+     */
+    template<typename F>
+    void ForEach(F fn)
+    {
+      for (auto &slot : _slots)
+        if (slot.first != 0)
+          fn(slot.first, slot.second);
+    }
+
+    template<typename F>
+    void ForEach(F fn) const
+    {
+      for (auto &slot : _slots)
+        if (slot.first != 0)
+          fn(slot.first, slot.second);
+    }
+
+    /**
+     * @brief remove every stored value
+     */
+    void Clear()
+    {
+      std::vector<std::pair<uint32_t, T>>(8).swap(_slots);
+      _size = 0;
+    }
+  private:
+    void grow()
+    {
+      std::vector<std::pair<uint32_t, T>> slots(_slots.size() * 2);
+      size_t mask = slots.size() - 1;
+
+      for (auto &slot : _slots)
+      {
+        if (slot.first == 0)
+          continue;
+
+        size_t i = slot.first & mask;
+        while (slots[i].first != 0)
+          i = (i + 1) & mask;
+
+        slots[i].first = slot.first;
+        slots[i].second = std::move(slot.second);
+      }
+
+      _slots.swap(slots);
+    }
+  }; // LuaEventIdMap
+
+}} // GarrysMod::Lua
+
+#endif//_GLOO_LUA_EVENT_ID_H_
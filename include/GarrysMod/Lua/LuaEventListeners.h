@@ -0,0 +1,281 @@
+#ifndef _GLOO_LUA_EVENT_LISTENERS_H_
+#define _GLOO_LUA_EVENT_LISTENERS_H_
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "LuaEventId.h"
+#include "GarrysMod/Lua/Interface.h"
+
+namespace GarrysMod {
+namespace Lua {
+
+  /**
+   * @brief listener registry of one event emitter
+   *
+   * Listeners live in generation checked slots so a handle is removed in
+   * constant time and stale handles are rejected.  Dispatch iterates an
+   * immutable snapshot which writers replace under a lock, callbacks may add
+   * or remove listeners without invalidating the snapshot being dispatched.
+   * Added listeners are queued and merged when the dispatcher next acquires
+   * the snapshot, copying each touched list once however many listeners it
+   * gained.  Removed listeners are flagged at once and pruned from the
+   * snapshot once they outnumber the live ones.
+   */
+  class LuaEventListeners
+  {
+  public:
+    static const int      slot_bits = 20;
+    static const uint32_t max_slots = (uint32_t)1 << slot_bits;
+
+    struct Listener
+    {
+      LuaEventId        id;
+      int               ref;
+      bool              once;
+      bool              batch;
+      uint64_t          handle;
+      std::atomic<bool> removed;
+
+      Listener(LuaEventId id, int ref, bool once, bool batch, uint64_t handle) :
+        id(id), ref(ref), once(once), batch(batch), handle(handle), removed(false) {}
+    };
+
+    typedef std::vector<std::shared_ptr<Listener>> list_t;
+    typedef LuaEventIdMap<std::shared_ptr<const list_t>> map_t;
+
+    struct Snapshot
+    {
+      uint64_t version;
+      map_t    listeners;
+      map_t    batch_listeners;
+
+      Snapshot() : version(0) {}
+    };
+  private:
+    std::mutex                             _mtx;
+    std::vector<std::shared_ptr<Listener>> _slots;
+    std::vector<uint32_t>                  _generations;
+    std::vector<uint32_t>                  _free_slots;
+    // Listeners added since the snapshot was last published, in order
+    std::vector<std::shared_ptr<Listener>> _added;
+    size_t                                 _live;
+    size_t                                 _removed;
+    std::atomic<uint64_t>                  _version;
+    std::shared_ptr<const Snapshot>        _snapshot;
+  public:
+    /**
+     * @brief number of listeners not removed
+     */
+    size_t size() const { return _live; }
+  public:
+    LuaEventListeners() :
+      _live(0),
+      _removed(0),
+      _version(0),
+      _snapshot(std::make_shared<Snapshot>()) {}
+
+    LuaEventListeners(const LuaEventListeners&) = delete;
+    LuaEventListeners& operator= (const LuaEventListeners&) = delete;
+  public:
+    /**
+     * @brief add listener, safe to call while dispatching, it is dispatched
+     *  from the next acquired snapshot.  Amortized constant time.
+     * @param id    - event identifier
+     * @param ref   - lua reference to the callback, owned by the registry
+     * @param once  - remove after the first invocation
+     * @param batch - receive one batch of events per tick
+     * @return handle for Remove, 0 when every slot is in use
+     */
+    uint64_t Add(LuaEventId id, int ref, bool once, bool batch)
+    {
+      std::unique_lock<std::mutex> lock(_mtx);
+      uint32_t slot;
+
+      if (!_free_slots.empty())
+      {
+        slot = _free_slots.back();
+        _free_slots.pop_back();
+      }
+      else if (_slots.size() < max_slots)
+      {
+        slot = (uint32_t)_slots.size();
+        _slots.emplace_back();
+        _generations.push_back(1);
+      }
+      else
+        return 0;
+
+      uint64_t handle = ((uint64_t)_generations[slot] << slot_bits) | slot;
+      auto listener = std::make_shared<Listener>(id, ref, once, batch, handle);
+
+      _slots[slot] = listener;
+      _added.push_back(std::move(listener));
+      _live++;
+
+      // Snapshots held by dispatchers are stale from now on
+      _version.fetch_add(1, std::memory_order_release);
+      return handle;
+    }
+
+    /**
+     * @brief remove listener and free its callback reference, lua thread only
+     * @param state  - lua state
+     * @param handle - handle returned by Add
+     * @return false if handle does not name a live listener
+     */
+    bool Remove(lua_State *state, uint64_t handle)
+    {
+      std::unique_lock<std::mutex> lock(_mtx);
+
+      uint32_t slot = (uint32_t)(handle & (max_slots - 1));
+      uint64_t generation = handle >> slot_bits;
+
+      if (slot >= _slots.size() || _generations[slot] != generation || !_slots[slot])
+        return false;
+
+      // Snapshots still holding the listener skip it from now on
+      _slots[slot]->removed.store(true, std::memory_order_relaxed);
+      LUA->ReferenceFree(_slots[slot]->ref);
+
+      _slots[slot].reset();
+      _generations[slot]++;
+      _free_slots.push_back(slot);
+      _live--;
+
+      // Pruning once removed listeners outnumber live ones keeps Remove
+      // amortized constant
+      if (++_removed > _live)
+        prune();
+
+      return true;
+    }
+
+    /**
+     * @brief remove every listener, lua thread only
+     * @param state - lua state
+     */
+    void Clear(lua_State *state)
+    {
+      std::unique_lock<std::mutex> lock(_mtx);
+
+      for (uint32_t slot = 0; slot < _slots.size(); slot++)
+      {
+        if (!_slots[slot])
+          continue;
+
+        _slots[slot]->removed.store(true, std::memory_order_relaxed);
+        LUA->ReferenceFree(_slots[slot]->ref);
+
+        _slots[slot].reset();
+        _generations[slot]++;
+        _free_slots.push_back(slot);
+      }
+
+      _added.clear();
+      _live = 0;
+      _removed = 0;
+
+      publish(std::make_shared<Snapshot>());
+    }
+
+    /**
+     * @brief refresh snapshot if listeners changed since it was taken,
+     *  merging added listeners first
+     * @param snapshot - snapshot held by the dispatcher, may be empty
+     * @return current snapshot
+     */
+    const Snapshot& Acquire(std::shared_ptr<const Snapshot> &snapshot)
+    {
+      if (!snapshot || snapshot->version != _version.load(std::memory_order_acquire))
+      {
+        std::unique_lock<std::mutex> lock(_mtx);
+
+        if (!_added.empty())
+        {
+          std::shared_ptr<Snapshot> next = std::make_shared<Snapshot>(*_snapshot);
+
+          merge(*next);
+          publish(std::move(next));
+        }
+
+        snapshot = _snapshot;
+      }
+
+      return *snapshot;
+    }
+  private:
+    void publish(std::shared_ptr<Snapshot> snapshot)
+    {
+      snapshot->version = _version.load(std::memory_order_relaxed) + 1;
+
+      std::atomic_store(&_snapshot, std::shared_ptr<const Snapshot>(std::move(snapshot)));
+      _version.fetch_add(1, std::memory_order_release);
+    }
+
+    void prune()
+    {
+      std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+
+      // Filter the existing lists rather than the slots to keep
+      // registration order
+      auto filter = [](map_t &target)
+      {
+        return [&target](uint32_t, const std::shared_ptr<const list_t> &current)
+        {
+          std::shared_ptr<list_t> list = std::make_shared<list_t>();
+
+          for (auto &entry : *current)
+            if (!entry->removed.load(std::memory_order_relaxed))
+              list->push_back(entry);
+
+          if (!list->empty())
+            target[list->front()->id] = std::move(list);
+        };
+      };
+
+      _snapshot->listeners.ForEach(filter(snapshot->listeners));
+      _snapshot->batch_listeners.ForEach(filter(snapshot->batch_listeners));
+
+      merge(*snapshot);
+
+      _removed = 0;
+      publish(std::move(snapshot));
+    }
+
+    void merge(Snapshot &snapshot)
+    {
+      // Lists are copied on first touch, every other list stays shared
+      LuaEventIdMap<std::shared_ptr<list_t>> copies[2];
+
+      for (auto &listener : _added)
+      {
+        if (listener->removed.load(std::memory_order_relaxed))
+          continue;
+
+        map_t &map = listener->batch ? snapshot.batch_listeners : snapshot.listeners;
+        auto &list = copies[listener->batch][listener->id];
+
+        if (!list)
+        {
+          list = std::make_shared<list_t>();
+
+          if (auto current = map.Find(listener->id))
+            for (auto &entry : **current)
+              if (!entry->removed.load(std::memory_order_relaxed))
+                list->push_back(entry);
+        }
+
+        list->push_back(listener);
+        map[listener->id] = list;
+      }
+
+      _added.clear();
+    }
+  }; // LuaEventListeners
+
+}} // GarrysMod::Lua
+
+#endif//_GLOO_LUA_EVENT_LISTENERS_H_
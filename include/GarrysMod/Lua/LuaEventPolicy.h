@@ -0,0 +1,281 @@
+#ifndef _GLOO_LUA_EVENT_POLICY_H_
+#define _GLOO_LUA_EVENT_POLICY_H_
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+#include <functional>
+#include "LuaEventId.h"
+#include "LuaEventArgs.h"
+
+namespace GarrysMod {
+namespace Lua {
+
+  /**
+   * @brief result of LuaEventEmitter::Emit
+   */
+  enum class LuaEventStatus
+  {
+    QUEUED,          // event was queued
+    COALESCED,       // event replaced the pending event of the same name
+    REPLACED_OLDEST, // event was queued, the oldest pending event of the same name is dropped
+    DROPPED          // event was dropped
+  };
+
+  /**
+   * @brief lane an event is queued in, lanes are drained highest first
+   */
+  enum class LuaEventPriority
+  {
+    HIGH,
+    NORMAL,
+    LOW
+  };
+
+  /**
+   * @brief queueing policy applied to every event of one name
+   */
+  struct LuaEventPolicy
+  {
+    enum Mode
+    {
+      QUEUE,       // queue every event, bounded by the lane only
+      COALESCE,    // keep only the latest pending event
+      DROP_OLDEST, // keep at most capacity pending events, dropping the oldest
+      DROP_NEWEST  // keep at most capacity pending events, rejecting new ones
+    };
+
+    Mode     mode;
+    // Pending events kept by DROP_OLDEST and DROP_NEWEST, 0 for other modes
+    uint32_t capacity;
+    // Lane every event of the name is queued in, whatever priority Emit is
+    // given, so pending events of one name are always popped oldest first
+    LuaEventPriority priority;
+    // Number of pending events that triggers on_high_watermark, 0 disables it
+    uint32_t high_watermark;
+    // Called on the emitting thread each time the pending count rises to high_watermark
+    std::function<void(LuaEventId id, size_t pending)> on_high_watermark;
+
+    LuaEventPolicy(Mode mode = QUEUE, uint32_t capacity = 0) :
+      mode(mode),
+      capacity(capacity),
+      priority(LuaEventPriority::NORMAL),
+      high_watermark(0) {}
+
+    static LuaEventPolicy Coalesce() { return LuaEventPolicy(COALESCE); }
+    static LuaEventPolicy DropOldest(uint32_t capacity) { return LuaEventPolicy(DROP_OLDEST, capacity); }
+    static LuaEventPolicy DropNewest(uint32_t capacity) { return LuaEventPolicy(DROP_NEWEST, capacity); }
+  }; // LuaEventPolicy
+
+  /**
+   * @brief pending event accounting for one event name
+   *
+   * Counted modes keep the number of queued events and the number of queued
+   * events already superseded in one atomic word, producers and the consumer
+   * update it with compare-exchange and never wait on each other.  Coalesced
+   * events swap their latest arguments in through an atomic pointer whose low
+   * bit records that a marker event is queued.  The producer setting that bit
+   * queues the single empty marker, which takes the arguments out when
+   * popped.  Argument buffers are recycled through a spare slot so steady
+   * coalescing does not allocate.
+   */
+  class LuaEventPolicyState
+  {
+  private:
+    static const uint64_t  queued_one = (uint64_t)1 << 32;
+    static const uint64_t  stale_mask = queued_one - 1;
+    static const uintptr_t marked = 1;
+  private:
+    const LuaEventPolicy  _policy;
+    const LuaEventId      _id;
+    // Queued events in the upper half, superseded events in the lower half
+    std::atomic<uint64_t> _counts;
+    // Latest coalesced arguments, owned by whoever exchanges them out, with
+    // the marked bit set while a marker event is queued
+    std::atomic<uintptr_t> _latest;
+    // Emptied argument buffer kept for the next coalesced event
+    std::atomic<LuaEventArgs*> _spare;
+  public:
+    const LuaEventPolicy& policy() const { return _policy; }
+
+    /**
+     * @brief number of pending events that will reach lua
+     */
+    size_t pending() const
+    {
+      if (_policy.mode == LuaEventPolicy::COALESCE)
+        return (_latest.load(std::memory_order_relaxed) & ~marked) ? 1 : 0;
+
+      uint64_t counts = _counts.load(std::memory_order_relaxed);
+      return (size_t)((counts >> 32) - (counts & stale_mask));
+    }
+
+    /**
+     * @brief check if no queued event refers to this state, only meaningful
+     *  once no producer can reach the state any more
+     */
+    bool idle() const
+    {
+      if (_policy.mode == LuaEventPolicy::COALESCE)
+        return !(_latest.load(std::memory_order_acquire) & marked);
+
+      return (_counts.load(std::memory_order_acquire) >> 32) == 0;
+    }
+  public:
+    /**
+     * @throw std::runtime_error if capacity is set for a mode without one
+     */
+    LuaEventPolicyState(LuaEventId id, const LuaEventPolicy &policy) :
+      _policy(policy),
+      _id(id),
+      _counts(0),
+      _latest(0),
+      _spare(nullptr)
+    {
+      if (policy.capacity && (policy.mode == LuaEventPolicy::QUEUE || policy.mode == LuaEventPolicy::COALESCE))
+        throw std::runtime_error("Event policy capacity only applies to DROP_OLDEST and DROP_NEWEST");
+    }
+
+    ~LuaEventPolicyState()
+    {
+      delete (LuaEventArgs*)(_latest.load(std::memory_order_relaxed) & ~marked);
+      delete _spare.load(std::memory_order_relaxed);
+    }
+
+    LuaEventPolicyState(const LuaEventPolicyState&) = delete;
+    LuaEventPolicyState& operator= (const LuaEventPolicyState&) = delete;
+  public:
+    /**
+     * @brief apply policy to an event, safe to call from any thread
+     * @param args - event arguments, moved from when coalesced
+     * @param push - bool() enqueueing the event, called at most once
+     * @return what happened to the event
+     */
+    template<typename F>
+    LuaEventStatus Emit(LuaEventArgs &args, F push)
+    {
+      if (_policy.mode == LuaEventPolicy::COALESCE)
+      {
+        LuaEventArgs *buffer = _spare.exchange(nullptr, std::memory_order_acquire);
+
+        if (!buffer)
+          buffer = new LuaEventArgs();
+
+        buffer->Move(args);
+
+        uintptr_t latest = _latest.load(std::memory_order_relaxed);
+
+        while (!_latest.compare_exchange_weak(latest, (uintptr_t)buffer | marked, std::memory_order_acq_rel, std::memory_order_relaxed))
+          ;
+
+        recycle((LuaEventArgs*)(latest & ~marked));
+
+        // A marker is already queued and will deliver the new arguments
+        if (latest & marked)
+          return LuaEventStatus::COALESCED;
+
+        if (push())
+          return LuaEventStatus::QUEUED;
+
+        // No marker was queued, clear the bit so the next event queues one.
+        // Arguments coalesced meanwhile stay pending until that event
+        // replaces them, only these are dropped.
+        latest = _latest.load(std::memory_order_relaxed);
+
+        while (!_latest.compare_exchange_weak(latest, latest & ~marked, std::memory_order_acq_rel, std::memory_order_relaxed))
+          ;
+
+        return LuaEventStatus::DROPPED;
+      }
+
+      uint64_t counts = _counts.load(std::memory_order_relaxed);
+      uint64_t live;
+
+      do
+      {
+        live = (counts >> 32) - (counts & stale_mask);
+
+        if (_policy.mode == LuaEventPolicy::DROP_NEWEST && _policy.capacity && live >= _policy.capacity)
+          return LuaEventStatus::DROPPED;
+      }
+      while (!_counts.compare_exchange_weak(counts, counts + queued_one, std::memory_order_relaxed));
+
+      if (!push())
+      {
+        _counts.fetch_sub(queued_one, std::memory_order_relaxed);
+        return LuaEventStatus::DROPPED;
+      }
+
+      LuaEventStatus status = LuaEventStatus::QUEUED;
+
+      if (_policy.mode == LuaEventPolicy::DROP_OLDEST && _policy.capacity)
+      {
+        counts = _counts.load(std::memory_order_relaxed);
+
+        // Mark the oldest pending event stale, the consumer discards it
+        while ((counts >> 32) - (counts & stale_mask) > _policy.capacity)
+        {
+          if (_counts.compare_exchange_weak(counts, counts + 1, std::memory_order_relaxed))
+          {
+            status = LuaEventStatus::REPLACED_OLDEST;
+            break;
+          }
+        }
+      }
+
+      if (_policy.high_watermark && live + 1 == _policy.high_watermark && _policy.on_high_watermark)
+        _policy.on_high_watermark(_id, (size_t)(live + 1));
+
+      return status;
+    }
+
+    /**
+     * @brief account for a popped event, consumer thread only
+     * @param args - popped event arguments, replaced by the latest ones when coalesced
+     * @return false if the event was superseded and must be discarded
+     */
+    bool Take(LuaEventArgs &args)
+    {
+      if (_policy.mode == LuaEventPolicy::COALESCE)
+      {
+        LuaEventArgs *latest = (LuaEventArgs*)(_latest.exchange(0, std::memory_order_acq_rel) & ~marked);
+
+        // A queued marker always finds arguments, they are only taken here
+        if (!latest)
+          return false;
+
+        args.Move(*latest);
+        recycle(latest);
+        return true;
+      }
+
+      uint64_t counts = _counts.load(std::memory_order_relaxed);
+      uint64_t next;
+
+      do
+      {
+        next = counts - queued_one;
+
+        // Events are popped oldest first, so a stale mark always claims this one
+        if (counts & stale_mask)
+          next--;
+      }
+      while (!_counts.compare_exchange_weak(counts, next, std::memory_order_relaxed));
+
+      return (counts & stale_mask) == 0;
+    }
+  private:
+    void recycle(LuaEventArgs *buffer)
+    {
+      if (!buffer)
+        return;
+
+      buffer->Clear();
+      delete _spare.exchange(buffer, std::memory_order_acq_rel);
+    }
+  }; // LuaEventPolicyState
+
+}} // GarrysMod::Lua
+
+#endif//_GLOO_LUA_EVENT_POLICY_H_
@@ -0,0 +1,152 @@
+#ifndef _GLOO_LUA_EVENT_QUEUE_H_
+#define _GLOO_LUA_EVENT_QUEUE_H_
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <utility>
+
+namespace GarrysMod {
+namespace Lua {
+
+  /**
+   * @brief bounded lock-free multi-producer/single-consumer ring buffer
+   *
+   * Producers claim a cell by advancing the enqueue cursor and publish it by
+   * bumping the cell sequence.  The consumer owns the dequeue cursor outright
+   * so popping never waits on, or makes producers wait on, a lock.
+   */
+  template<typename T>
+  class LuaEventQueue
+  {
+  private:
+    struct Cell
+    {
+      std::atomic<size_t> sequence;
+      T                   data;
+    };
+  private:
+    std::unique_ptr<Cell[]> _cells;
+    size_t                  _mask;
+    // Keep producer and consumer cursors on separate cache lines
+    char                    _producer_pad[64];
+    std::atomic<size_t>     _enqueue_pos;
+    char                    _consumer_pad[64];
+    size_t                  _dequeue_pos;
+  public:
+    /**
+     * @brief maximum number of queued items
+     */
+    size_t capacity() const { return _mask + 1; }
+
+    /**
+     * @brief number of claimed cells not yet popped, consumer thread only
+     */
+    size_t size() const
+    {
+      return _enqueue_pos.load(std::memory_order_relaxed) - _dequeue_pos;
+    }
+  public:
+    /**
+     * @param capacity - minimum number of items to hold, rounded up to a power of two
+     */
+    explicit LuaEventQueue(size_t capacity) :
+      _mask(0),
+      _enqueue_pos(0),
+      _dequeue_pos(0)
+    {
+      size_t size = Capacity(capacity);
+
+      _mask = size - 1;
+      _cells.reset(new Cell[size]);
+
+      for (size_t i = 0; i < size; i++)
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    LuaEventQueue(const LuaEventQueue&) = delete;
+    LuaEventQueue& operator= (const LuaEventQueue&) = delete;
+  public:
+    /**
+     * @brief capacity a queue constructed with capacity ends up with
+     * @param capacity - minimum number of items to hold
+     */
+    static size_t Capacity(size_t capacity)
+    {
+      size_t size = 2;
+      while (size < capacity)
+        size <<= 1;
+
+      return size;
+    }
+
+    /**
+     * @brief enqueue item, safe to call from any number of threads
+     * @param value - item to enqueue
+     * @return false when the queue is full and the item was not enqueued
+     */
+    bool Push(T &&value)
+    {
+      Cell  *cell;
+      size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+
+      for (;;)
+      {
+        cell = &_cells[pos & _mask];
+
+        size_t    sequence = cell->sequence.load(std::memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+
+        // Cell is free, attempt to claim it
+        if (diff == 0)
+        {
+          if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+        }
+        // Cell still holds an item the consumer has not popped, queue is full
+        else if (diff < 0)
+          return false;
+        // Another producer claimed the cell, reload cursor
+        else
+          pos = _enqueue_pos.load(std::memory_order_relaxed);
+      }
+
+      cell->data = std::move(value);
+      cell->sequence.store(pos + 1, std::memory_order_release);
+
+      return true;
+    }
+
+    /**
+     * @brief dequeue item, must only be called from the consumer thread
+     * @param value - receives dequeued item
+     * @return false when no published item is available
+     */
+    bool Pop(T &value)
+    {
+      Cell  *cell = &_cells[_dequeue_pos & _mask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+
+      if (sequence != _dequeue_pos + 1)
+        return false;
+
+      value = std::move(cell->data);
+      cell->sequence.store(_dequeue_pos + _mask + 1, std::memory_order_release);
+      _dequeue_pos++;
+
+      return true;
+    }
+
+    /**
+     * @brief check if a published item is available, consumer thread only
+     */
+    bool Empty() const
+    {
+      const Cell *cell = &_cells[_dequeue_pos & _mask];
+      return cell->sequence.load(std::memory_order_acquire) != _dequeue_pos + 1;
+    }
+  }; // LuaEventQueue
+
+}} // GarrysMod::Lua
+
+#endif//_GLOO_LUA_EVENT_QUEUE_H_
@@ -0,0 +1,666 @@
+#ifndef _GLOO_LUA_JSON_H_
+#define _GLOO_LUA_JSON_H_
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include "LuaValue.h"
+#include "GarrysMod/Lua/Interface.h"
+
+namespace GarrysMod {
+namespace Lua {
+
+  /**
+   * @brief JSON parser and serializer targeting LuaValue and the lua stack
+   *
+   * Arrays become tables with keys 1..n, objects tables with string keys and
+   * null becomes nil.  Numbers that fit a double exactly skip strtod.
+   */
+  class LuaJson
+  {
+  private:
+    // Largest number of entries reserved ahead from a sibling's shape
+    static const size_t max_hint = 64;
+
+    class Reader
+    {
+    private:
+      const char  *_begin;
+      const char  *_pos;
+      const char  *_end;
+      std::string  _scratch;
+    public:
+      Reader(const char *data, size_t size) : _begin(data), _pos(data), _end(data + size) {}
+    public:
+      /**
+       * @brief skip whitespace and return next character without consuming it
+       */
+      char Peek()
+      {
+        skipWhitespace();
+
+        if (_pos == _end)
+          Fail("unexpected end of input");
+
+        return *_pos;
+      }
+
+      void Expect(char c)
+      {
+        if (Peek() != c)
+          Fail(std::string("expected '") + c + "'");
+
+        _pos++;
+      }
+
+      /**
+       * @brief consume c if it is the next character
+       */
+      bool Accept(char c)
+      {
+        if (Peek() != c)
+          return false;
+
+        _pos++;
+        return true;
+      }
+
+      void Finish()
+      {
+        skipWhitespace();
+
+        if (_pos != _end)
+          Fail("trailing data");
+      }
+
+      void Literal(const char *literal, size_t len)
+      {
+        if ((size_t)(_end - _pos) < len || std::memcmp(_pos, literal, len) != 0)
+          Fail("invalid literal");
+
+        _pos += len;
+      }
+
+      /**
+       * @brief parse string, the view points into the input when the string
+       *  has no escapes and is valid until the next call otherwise
+       */
+      LuaStringView String()
+      {
+        Expect('"');
+
+        const char *start = _pos;
+        const char *stop = scanString(_pos, _end);
+
+        if (stop != _end && *stop == '"')
+        {
+          _pos = stop + 1;
+          return LuaStringView(start, stop - start);
+        }
+
+        // Slow path, decode escapes into scratch buffer
+        _scratch.assign(start, stop);
+        _pos = stop;
+
+        for (;;)
+        {
+          if (_pos == _end)
+            Fail("unterminated string");
+
+          char c = *_pos;
+
+          if (c == '"')
+          {
+            _pos++;
+            return LuaStringView(_scratch);
+          }
+
+          if (c != '\\')
+          {
+            if ((unsigned char)c < 0x20)
+              Fail("control character in string");
+
+            stop = scanString(_pos, _end);
+            _scratch.append(_pos, stop);
+            _pos = stop;
+            continue;
+          }
+
+          if (++_pos == _end)
+            Fail("unterminated string");
+
+          switch (*_pos++)
+          {
+            case '"': _scratch += '"'; break;
+            case '\\': _scratch += '\\'; break;
+            case '/': _scratch += '/'; break;
+            case 'b': _scratch += '\b'; break;
+            case 'f': _scratch += '\f'; break;
+            case 'n': _scratch += '\n'; break;
+            case 'r': _scratch += '\r'; break;
+            case 't': _scratch += '\t'; break;
+            case 'u': codepoint(); break;
+            default: Fail("invalid escape");
+          }
+        }
+      }
+
+      double Number()
+      {
+        static const double pow10[] = {
+          1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+          1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        const char *start = _pos;
+        bool        negative = *_pos == '-';
+        uint64_t    mantissa = 0;
+        int         digits = 0;
+        int         exponent = 0;
+
+        if (negative)
+          _pos++;
+
+        if (_pos == _end || !isDigit(*_pos))
+          Fail("invalid number");
+
+        // Integer part, a leading zero stands alone
+        if (*_pos == '0')
+          _pos++;
+        else
+          for (; _pos != _end && isDigit(*_pos); _pos++, digits++)
+            mantissa = mantissa * 10 + (*_pos - '0');
+
+        if (_pos != _end && *_pos == '.')
+        {
+          if (++_pos == _end || !isDigit(*_pos))
+            Fail("invalid number");
+
+          for (; _pos != _end && isDigit(*_pos); _pos++, digits++, exponent--)
+            mantissa = mantissa * 10 + (*_pos - '0');
+        }
+
+        if (_pos != _end && (*_pos == 'e' || *_pos == 'E'))
+        {
+          bool negative_exponent = false;
+          int  value = 0;
+
+          if (++_pos != _end && (*_pos == '+' || *_pos == '-'))
+            negative_exponent = *_pos++ == '-';
+
+          if (_pos == _end || !isDigit(*_pos))
+            Fail("invalid number");
+
+          for (; _pos != _end && isDigit(*_pos); _pos++)
+            value = value < 10000 ? value * 10 + (*_pos - '0') : value;
+
+          exponent += negative_exponent ? -value : value;
+        }
+
+        // Mantissa and power of ten are both exact, one rounding step
+        if (digits <= 19 && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+        {
+          double value = (double)mantissa;
+          value = exponent < 0 ? value / pow10[-exponent] : value * pow10[exponent];
+          return negative ? -value : value;
+        }
+
+        return std::strtod(std::string(start, _pos).c_str(), nullptr);
+      }
+
+      void Fail(const std::string &message) const
+      {
+        throw std::runtime_error("Unable to parse json at offset " + std::to_string(_pos - _begin) + ", " + message);
+      }
+    private:
+      static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+      void skipWhitespace()
+      {
+        while (_pos != _end && (*_pos == ' ' || *_pos == '\n' || *_pos == '\r' || *_pos == '\t'))
+          _pos++;
+      }
+
+      unsigned hex()
+      {
+        unsigned value = 0;
+
+        if (_end - _pos < 4)
+          Fail("invalid unicode escape");
+
+        for (int i = 0; i < 4; i++)
+        {
+          char c = *_pos++;
+
+          value <<= 4;
+          if (c >= '0' && c <= '9') value |= c - '0';
+          else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+          else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+          else Fail("invalid unicode escape");
+        }
+
+        return value;
+      }
+
+      void codepoint()
+      {
+        unsigned cp = hex();
+
+        // Combine surrogate pair
+        if (cp >= 0xd800 && cp <= 0xdbff)
+        {
+          if (_end - _pos < 2 || _pos[0] != '\\' || _pos[1] != 'u')
+            Fail("unpaired surrogate");
+
+          _pos += 2;
+          unsigned low = hex();
+
+          if (low < 0xdc00 || low > 0xdfff)
+            Fail("unpaired surrogate");
+
+          cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+        }
+        else if (cp >= 0xdc00 && cp <= 0xdfff)
+          Fail("unpaired surrogate");
+
+        // Encode as UTF-8
+        if (cp < 0x80)
+          _scratch += (char)cp;
+        else if (cp < 0x800)
+        {
+          _scratch += (char)(0xc0 | (cp >> 6));
+          _scratch += (char)(0x80 | (cp & 0x3f));
+        }
+        else if (cp < 0x10000)
+        {
+          _scratch += (char)(0xe0 | (cp >> 12));
+          _scratch += (char)(0x80 | ((cp >> 6) & 0x3f));
+          _scratch += (char)(0x80 | (cp & 0x3f));
+        }
+        else
+        {
+          _scratch += (char)(0xf0 | (cp >> 18));
+          _scratch += (char)(0x80 | ((cp >> 12) & 0x3f));
+          _scratch += (char)(0x80 | ((cp >> 6) & 0x3f));
+          _scratch += (char)(0x80 | (cp & 0x3f));
+        }
+      }
+    }; // Reader
+  public:
+    /**
+     * @brief parse JSON document
+     * @param data   - JSON text
+     * @param size   - length of JSON text
+     * @param limits - depth limit
+     * @return parsed value
+     * @throw std::runtime_error
+     */
+    static LuaValue Parse(const char *data, size_t size, const LuaPopLimits &limits = LuaPopLimits())
+    {
+      Reader              reader(data, size);
+      std::vector<size_t> hints;
+      LuaValue            value = readValue(reader, limits, 0, hints);
+
+      reader.Finish();
+      return value;
+    }
+
+    static LuaValue Parse(const std::string &json, const LuaPopLimits &limits = LuaPopLimits())
+    {
+      return Parse(json.data(), json.size(), limits);
+    }
+
+    /**
+     * @brief parse JSON document straight onto the lua stack without
+     *  building a LuaValue
+     * @param state  - Lua state
+     * @param data   - JSON text
+     * @param size   - length of JSON text
+     * @param limits - depth limit
+     * @return number of items pushed to stack
+     * @throw std::runtime_error
+     */
+    static int Push(lua_State *state, const char *data, size_t size, const LuaPopLimits &limits = LuaPopLimits())
+    {
+      int    top = LUA->Top();
+      Reader reader(data, size);
+
+      try
+      {
+        pushValue(state, reader, limits, 0);
+        reader.Finish();
+      }
+      catch (...)
+      {
+        LUA->Pop(LUA->Top() - top);
+        throw;
+      }
+
+      return 1;
+    }
+
+    /**
+     * @brief serialize value as JSON, tables whose keys are exactly 1..n
+     *  become arrays, empty tables become []
+     * @param value  - lua value
+     * @param limits - depth limit
+     * @return JSON text
+     * @throw std::runtime_error
+     */
+    static std::string Stringify(const LuaValue &value, const LuaPopLimits &limits = LuaPopLimits())
+    {
+      std::string out;
+      writeValue(out, value, limits, 0);
+      return out;
+    }
+  private:
+    /**
+     * @brief find first quote, backslash or control character
+     */
+    static const char* scanString(const char *pos, const char *end)
+    {
+      for (; pos != end; pos++)
+      {
+        unsigned char c = (unsigned char)*pos;
+        if (c == '"' || c == '\\' || c < 0x20)
+          return pos;
+      }
+
+      return end;
+    }
+
+    static size_t& depthHint(std::vector<size_t> &hints, size_t depth)
+    {
+      if (hints.size() <= depth)
+        hints.resize(depth + 1);
+
+      return hints[depth];
+    }
+
+    static void checkDepth(const Reader &reader, const LuaPopLimits &limits, size_t depth)
+    {
+      if (depth >= limits.max_depth)
+        reader.Fail("nested deeper than " + std::to_string(limits.max_depth));
+    }
+
+    /**
+     * @brief parse value, tables are reserved for as many entries as the
+     *  previous table at the same depth had since documents tend to repeat
+     *  the same shape
+     * @param hints - entry count of the last table parsed at each depth
+     */
+    static LuaValue readValue(Reader &reader, const LuaPopLimits &limits, size_t depth, std::vector<size_t> &hints)
+    {
+      switch (reader.Peek())
+      {
+        case 'n': reader.Literal("null", 4); return LuaValue();
+        case 't': reader.Literal("true", 4); return LuaValue(true);
+        case 'f': reader.Literal("false", 5); return LuaValue(false);
+        case '"': return LuaValue(reader.String().str());
+        case '[':
+        {
+          checkDepth(reader, limits, depth);
+          reader.Expect('[');
+
+          LuaTable table(LuaArena::Current());
+
+          if (reader.Accept(']'))
+            return LuaValue(std::move(table));
+
+          LuaValue::number_t index = 1;
+
+          table.Reserve(std::min(depthHint(hints, depth), (size_t)max_hint), 0);
+
+          do
+          {
+            LuaValue value = readValue(reader, limits, depth + 1, hints);
+
+            // null leaves a hole
+            if (value.type() != Type::NIL)
+              table.Emplace(LuaValue(index), std::move(value));
+
+            index++;
+          }
+          while (reader.Accept(','));
+
+          reader.Expect(']');
+          depthHint(hints, depth) = (size_t)index - 1;
+          return LuaValue(std::move(table));
+        }
+        case '{':
+        {
+          checkDepth(reader, limits, depth);
+          reader.Expect('{');
+
+          LuaTable table(LuaArena::Current());
+
+          if (reader.Accept('}'))
+            return LuaValue(std::move(table));
+
+          size_t entries = 0;
+
+          table.Reserve(0, std::min(depthHint(hints, depth), (size_t)max_hint));
+
+          do
+          {
+            if (reader.Peek() != '"')
+              reader.Fail("expected string key");
+
+            LuaValue key(reader.String().str());
+
+            reader.Expect(':');
+
+            LuaValue value = readValue(reader, limits, depth + 1, hints);
+
+            if (value.type() != Type::NIL)
+              table.Emplace(std::move(key), std::move(value));
+
+            entries++;
+          }
+          while (reader.Accept(','));
+
+          reader.Expect('}');
+          depthHint(hints, depth) = entries;
+          return LuaValue(std::move(table));
+        }
+        default: return LuaValue(reader.Number());
+      }
+    }
+
+    static void pushValue(lua_State *state, Reader &reader, const LuaPopLimits &limits, size_t depth)
+    {
+      switch (reader.Peek())
+      {
+        case 'n': reader.Literal("null", 4); LUA->PushNil(); break;
+        case 't': reader.Literal("true", 4); LUA->PushBool(true); break;
+        case 'f': reader.Literal("false", 5); LUA->PushBool(false); break;
+        case '"': LuaValue::PushString(state, reader.String()); break;
+        case '[':
+        {
+          checkDepth(reader, limits, depth);
+          reader.Expect('[');
+          LUA->CreateTable();
+
+          if (reader.Accept(']'))
+            break;
+
+          double index = 1;
+
+          do
+          {
+            LUA->PushNumber(index++);
+            pushValue(state, reader, limits, depth + 1);
+
+            if (LUA->GetType(-1) == Type::NIL)
+              LUA->Pop(2);
+            else
+              LUA->RawSet(-3);
+          }
+          while (reader.Accept(','));
+
+          reader.Expect(']');
+          break;
+        }
+        case '{':
+        {
+          checkDepth(reader, limits, depth);
+          reader.Expect('{');
+          LUA->CreateTable();
+
+          if (reader.Accept('}'))
+            break;
+
+          do
+          {
+            if (reader.Peek() != '"')
+              reader.Fail("expected string key");
+
+            LuaValue::PushString(state, reader.String());
+            reader.Expect(':');
+            pushValue(state, reader, limits, depth + 1);
+
+            if (LUA->GetType(-1) == Type::NIL)
+              LUA->Pop(2);
+            else
+              LUA->RawSet(-3);
+          }
+          while (reader.Accept(','));
+
+          reader.Expect('}');
+          break;
+        }
+        default: LUA->PushNumber(reader.Number()); break;
+      }
+    }
+
+    static void writeString(std::string &out, LuaStringView str)
+    {
+      static const char hex[] = "0123456789abcdef";
+
+      const char *pos = str.data;
+      const char *end = str.data + str.size;
+
+      out += '"';
+
+      while (pos != end)
+      {
+        const char *stop = scanString(pos, end);
+
+        out.append(pos, stop);
+        if (stop == end)
+          break;
+
+        switch (*stop)
+        {
+          case '"': out += "\\\""; break;
+          case '\\': out += "\\\\"; break;
+          case '\b': out += "\\b"; break;
+          case '\f': out += "\\f"; break;
+          case '\n': out += "\\n"; break;
+          case '\r': out += "\\r"; break;
+          case '\t': out += "\\t"; break;
+          default:
+            out += "\\u00";
+            out += hex[(unsigned char)*stop >> 4];
+            out += hex[*stop & 0xf];
+            break;
+        }
+
+        pos = stop + 1;
+      }
+
+      out += '"';
+    }
+
+    static void writeNumber(std::string &out, double number)
+    {
+      char buffer[32];
+
+      if (!std::isfinite(number))
+        throw std::runtime_error("Unable to stringify non-finite number as json");
+
+      if (number >= -9007199254740992.0 && number <= 9007199254740992.0 && number == std::floor(number))
+        std::snprintf(buffer, sizeof(buffer), "%lld", (long long)number);
+      else
+        std::snprintf(buffer, sizeof(buffer), "%.17g", number);
+
+      out += buffer;
+    }
+
+    static void writeKey(std::string &out, const LuaValue &key)
+    {
+      switch (key.type())
+      {
+        case Type::STRING: writeString(out, key.view()); break;
+        case Type::NUMBER:
+        {
+          std::string number;
+          writeNumber(number, (LuaValue::number_t)key);
+          writeString(out, number);
+          break;
+        }
+        case Type::BOOL: out += (LuaValue::bool_t)key ? "\"true\"" : "\"false\""; break;
+        default:
+          throw std::runtime_error("Unable to stringify table key of lua type " + std::to_string(key.type()) + " as json");
+      }
+    }
+
+    static void writeValue(std::string &out, const LuaValue &value, const LuaPopLimits &limits, size_t depth)
+    {
+      switch (value.type())
+      {
+        case Type::NIL: out += "null"; break;
+        case Type::BOOL: out += (LuaValue::bool_t)value ? "true" : "false"; break;
+        case Type::NUMBER: writeNumber(out, (LuaValue::number_t)value); break;
+        case Type::STRING: writeString(out, value.view()); break;
+        case Type::TABLE:
+        {
+          if (depth >= limits.max_depth)
+            throw std::runtime_error("Unable to stringify table nested deeper than " + std::to_string(limits.max_depth));
+
+          const LuaTable &table = value.table();
+          bool            first = true;
+
+          if (table.array_size() == table.size())
+          {
+            out += '[';
+
+            for (const auto &pair : table)
+            {
+              if (!first) out += ',';
+              writeValue(out, pair.second, limits, depth + 1);
+              first = false;
+            }
+
+            out += ']';
+            break;
+          }
+
+          out += '{';
+
+          for (const auto &pair : table)
+          {
+            if (!first) out += ',';
+            writeKey(out, pair.first);
+            out += ':';
+            writeValue(out, pair.second, limits, depth + 1);
+            first = false;
+          }
+
+          out += '}';
+          break;
+        }
+        default:
+          throw std::runtime_error("Unable to stringify lua type " + std::to_string(value.type()) + " as json");
+      }
+    }
+  }; // LuaJson
+
+}} // GarrysMod::Lua
+
+#endif//_GLOO_LUA_JSON_H_
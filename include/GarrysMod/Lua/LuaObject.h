@@ -1,36 +1,192 @@
 #ifndef _GLOO_LUA_OBJECT_H_
 #define _GLOO_LUA_OBJECT_H_
 
+#include <map>
 #include <tuple>
+#include <new>
 #include <memory>
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <typeinfo>
 #include <functional>
+#include "LuaBind.h"
 #include "LuaValue.h"
 #include "GarrysMod/Lua/Interface.h"
 
 namespace GarrysMod {
 namespace Lua {
 
-  template<unsigned char TType, class TChildObject>
-  class LuaObject :
-    public std::enable_shared_from_this<TChildObject>
+  /**
+   * @brief hash table mapping names to callbacks, built once per class
+   *
+   * Lookups hash the raw lua string once and compare against the candidate
+   * slots without constructing a std::string.  The build searches a few
+   * seeds for one without collisions, which small classes nearly always get,
+   * so most lookups compare a single slot.
+   */
+  class LuaNameTable
+  {
+  private:
+    static const uint32_t max_seeds = 64;
+
+    struct Entry
+    {
+      std::string name;
+      CFunc       fn;
+      bool        used;
+
+      Entry() : fn(nullptr), used(false) {}
+    };
+  private:
+    std::vector<Entry> _slots;
+    uint32_t           _seed;
+    size_t             _mask;
+    // Longest distance of a name from its home slot
+    size_t             _max_probe;
+  public:
+    LuaNameTable() : _seed(0), _mask(0), _max_probe(0) {}
+  public:
+    /**
+     * @brief find callback by name
+     * @param name - name data, not required to be NUL terminated
+     * @param len  - length of name
+     * @return callback or nullptr when absent
+     */
+    CFunc Find(const char *name, size_t len) const
+    {
+      if (_slots.empty())
+        return nullptr;
+
+      size_t i = hash(_seed, name, len) & _mask;
+
+      for (size_t probe = 0; probe <= _max_probe; probe++, i = (i + 1) & _mask)
+      {
+        const Entry &entry = _slots[i];
+
+        if (!entry.used)
+          return nullptr;
+
+        if (entry.name.size() == len && std::memcmp(entry.name.data(), name, len) == 0)
+          return entry.fn;
+      }
+
+      return nullptr;
+    }
+
+    /**
+     * @brief build table from names, keeping the seed with the shortest
+     *  probe sequences
+     * @param names - name to callback map
+     */
+    void Build(const std::map<std::string, CFunc> &names)
+    {
+      // At most half full, so the table stays within four times the names
+      size_t size = 2;
+      while (size < names.size() * 2)
+        size <<= 1;
+
+      _slots.clear();
+
+      for (uint32_t seed = 0; seed < max_seeds; seed++)
+      {
+        std::vector<Entry> slots(size);
+        size_t             max_probe = 0;
+
+        for (const auto &name : names)
+        {
+          size_t i = hash(seed, name.first.data(), name.first.size()) & (size - 1);
+          size_t probe = 0;
+
+          for (; slots[i].used; probe++)
+            i = (i + 1) & (size - 1);
+
+          slots[i].name = name.first;
+          slots[i].fn = name.second;
+          slots[i].used = true;
+
+          if (probe > max_probe)
+            max_probe = probe;
+        }
+
+        if (_slots.empty() || max_probe < _max_probe)
+        {
+          _slots.swap(slots);
+          _seed = seed;
+          _mask = size - 1;
+          _max_probe = max_probe;
+        }
+
+        // Collision free, every lookup compares one slot
+        if (_max_probe == 0)
+          break;
+      }
+    }
+  private:
+    static uint32_t hash(uint32_t seed, const char *name, size_t len)
+    {
+      uint32_t hash = 2166136261u ^ (seed * 16777619u);
+
+      for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+
+      // Final avalanche so the low bits used for indexing depend on every byte
+      hash ^= hash >> 15;
+      hash *= 0x2c1b3c6du;
+      hash ^= hash >> 12;
+
+      return hash;
+    }
+  }; // LuaNameTable
+
+  /**
+   * @brief getters, setters, methods and metamethods shared by every object
+   *  of a class.  Filled once by the class' static Define method and
+   *  immutable afterwards.
+   */
+  class LuaObjectClass
   {
   private:
     std::map<std::string, CFunc> _getters;
     std::map<std::string, CFunc> _setters;
     std::map<std::string, CFunc> _methods;
-    std::map<lua_State*, int>    _references;
     std::map<std::string, CFunc> _metamethods;
+    LuaNameTable                 _getter_table;
+    LuaNameTable                 _setter_table;
+    LuaNameTable                 _method_table;
+    bool                         _native_methods;
   public:
-    int type() { return TType; }
-    virtual std::string name() { return "LuaObject"; }
+    LuaObjectClass() : _native_methods(false) {}
   public:
-    LuaObject() {
-      AddMetaMethod("__gc", __gc);
-      AddMetaMethod("__index", __index);
-      AddMetaMethod("__newindex", __newindex);
-      AddMetaMethod("__tostring", __tostring);
-    }
+    const std::map<std::string, CFunc>& getters() const { return _getters; }
+    const std::map<std::string, CFunc>& setters() const { return _setters; }
+    const std::map<std::string, CFunc>& methods() const { return _methods; }
+    const std::map<std::string, CFunc>& metamethods() const { return _metamethods; }
+
+    /**
+     * @brief get whether methods are resolved by the lua vm from a shared
+     *  __index table instead of the __index metamethod
+     */
+    bool native_methods() const { return _native_methods; }
+
+    /**
+     * @brief set whether methods are resolved by the lua vm from a shared
+     *  __index table.  Getters and unknown keys still fall back to a C
+     *  function, methods must not share names with getters.
+     */
+    void native_methods(bool value) { _native_methods = value; }
+  public:
+    /**
+     * @brief find getter, setter or method by raw lua string
+     * @param name - name data
+     * @param len  - length of name
+     * @return callback or nullptr when absent
+     */
+    CFunc FindGetter(const char *name, size_t len) const { return _getter_table.Find(name, len); }
+    CFunc FindSetter(const char *name, size_t len) const { return _setter_table.Find(name, len); }
+    CFunc FindMethod(const char *name, size_t len) const { return _method_table.Find(name, len); }
   public:
     /**
      * @brief define getter method to be used in __index metamethod
@@ -60,38 +216,205 @@ namespace Lua {
      */
     void AddMetaMethod(std::string name, CFunc fn) { _metamethods[name] = fn; }
 
+    /**
+     * @brief build the lookup tables of getters, setters and methods, called
+     *  once after Define has added every name
+     */
+    void Build()
+    {
+      _getter_table.Build(_getters);
+      _setter_table.Build(_setters);
+      _method_table.Build(_methods);
+    }
+  }; // LuaObjectClass
+
+  template<unsigned char TType, class TChildObject>
+  class LuaObject :
+    public std::enable_shared_from_this<TChildObject>
+  {
+  private:
+    // Lua userdata block, the handle lives next to the gmod UserData header
+    // so pushing an object costs no allocation besides the userdata itself
+    struct Handle
+    {
+      UserData                      ud;
+      std::shared_ptr<TChildObject> ptr;
+    };
+  private:
+    std::vector<std::pair<lua_State*, int>> _references;
+  public:
+    int type() { return TType; }
+    virtual std::string name() { return "LuaObject"; }
+  public:
+    /**
+     * @brief define default metamethods __gc, __index, __newindex and
+     *  __tostring.  Child classes hide this with their own public static
+     *  Define which must call their parent's Define first.
+     * @param cls - class definition
+     */
+    static void Define(LuaObjectClass &cls)
+    {
+      cls.AddMetaMethod("__gc", __gc);
+      cls.AddMetaMethod("__index", __index);
+      cls.AddMetaMethod("__newindex", __newindex);
+      cls.AddMetaMethod("__tostring", __tostring);
+    }
+
+    /**
+     * @brief get class definition, built by TChildObject::Define on first use
+     */
+    static const LuaObjectClass& Class()
+    {
+      static const LuaObjectClass cls = defineClass();
+      return cls;
+    }
+  public:
     /**
      * @brief push object to lua stack
      * @param state - lua state
      */
     int Push(lua_State *state)
     {
-      registerObject(state);
-      LUA->ReferencePush(_references[state]);
+      LUA->ReferencePush(registerObject(state));
       return 1;
     }
 
+    /**
+     * @brief drop the registry reference keeping the userdata of this object
+     *  alive in state, lua collects it once nothing else references it and
+     *  the next Push creates a new userdata
+     * @param state - lua state
+     */
+    void Unreference(lua_State *state)
+    {
+      auto reference = findReference(state);
+      if (reference == _references.end())
+        return;
+
+      LUA->ReferenceFree(reference->second);
+      _references.erase(reference);
+    }
+
     virtual void Destroy(lua_State *state) {}
   private:
-    void registerObject(lua_State *state)
+    static LuaObjectClass defineClass()
     {
-      if (_references.find(state) != _references.end())
-        return;
+      LuaObjectClass cls;
+      TChildObject::Define(cls);
+      cls.Build();
+      return cls;
+    }
+
+    std::vector<std::pair<lua_State*, int>>::iterator findReference(lua_State *state)
+    {
+      auto iter = _references.begin();
+
+      while (iter != _references.end() && iter->first != state)
+        ++iter;
+
+      return iter;
+    }
+
+    int registerObject(lua_State *state)
+    {
+      auto reference = findReference(state);
+      if (reference != _references.end())
+        return reference->second;
 
       auto self = std::static_pointer_cast<TChildObject>(std::enable_shared_from_this<TChildObject>::shared_from_this());
 
-      UserData *ud = (UserData*)LUA->NewUserdata(sizeof(UserData));
-        ud->data = (void*)new std::shared_ptr<TChildObject>(self);
-        ud->type = TType;
+      Handle *handle = (Handle*)LUA->NewUserdata(sizeof(Handle));
+        new (&handle->ptr) std::shared_ptr<TChildObject>(std::move(self));
+        handle->ud.data = (void*)&handle->ptr;
+        handle->ud.type = TType;
+      pushMetaTable(state);
+      LUA->SetMetaTable(-2);
+
+      _references.push_back(std::make_pair(state, LUA->ReferenceCreate()));
+      return _references.back().second;
+    }
+
+    /**
+     * @brief push metatable shared by every TChildObject in the lua state,
+     *  built from the class metamethods and cached in the registry
+     * @param state - lua state
+     */
+    static void pushMetaTable(lua_State *state)
+    {
+      LUA->PushSpecial(SPECIAL_REG);
+      LUA->GetField(-1, metaTableName());
+
+      if (!LUA->IsType(-1, Type::TABLE))
+      {
+        LUA->Pop();
+        LUA->CreateTable();
+          for (const auto &metamethod : Class().metamethods())
+          {
+            LUA->PushCFunction(metamethod.second);
+            LUA->SetField(-2, metamethod.first.c_str());
+          }
+
+          if (Class().native_methods())
+          {
+            pushNativeIndex(state);
+            LUA->SetField(-2, "__index");
+          }
+        // Cache metatable in registry
+        LUA->Push(-1);
+        LUA->SetField(-3, metaTableName());
+      }
+
+      // Remove registry, leaving metatable on top
+      LUA->Remove(-2);
+    }
+
+    /**
+     * @brief push __index used in native_methods mode.  Without getters this
+     *  is the methods table itself, otherwise a lua closure which indexes the
+     *  methods table and only calls into C for getters and unknown keys.
+     * @param state - lua state
+     */
+    static void pushNativeIndex(lua_State *state)
+    {
+      if (Class().getters().empty())
+      {
+        pushMethodsTable(state);
+        return;
+      }
+
+      LUA->PushSpecial(SPECIAL_GLOB);
+        LUA->GetField(-1, "CompileString");
+          LUA->PushString(
+            "local methods, fallback = ...\n"
+            "return function(self, key)\n"
+            "  local method = methods[key]\n"
+            "  if method ~= nil then return method end\n"
+            "  return fallback(self, key)\n"
+            "end\n"
+          );
+          LUA->PushString(metaTableName());
+          LUA->Call(2, 1);
+        pushMethodsTable(state);
+        LUA->PushCFunction(__index_getter);
+        LUA->Call(2, 1);
+      // Remove global table, leaving closure on top
+      LUA->Remove(-2);
+    }
+
+    static void pushMethodsTable(lua_State *state)
+    {
       LUA->CreateTable();
-        for (const auto &metamethod : _metamethods)
+        for (const auto &method : Class().methods())
         {
-          LUA->PushCFunction(metamethod.second);
-          LUA->SetField(-2, metamethod.first.c_str());
+          LUA->PushCFunction(method.second);
+          LUA->SetField(-2, method.first.c_str());
         }
-      LUA->SetMetaTable(-2);
+    }
 
-      _references[state] = LUA->ReferenceCreate();
+    static const char* metaTableName()
+    {
+      static const std::string name = "gloo_" + std::to_string(TType) + "_" + typeid(TChildObject).name();
+      return name.c_str();
     }
   public:
     /**
@@ -107,6 +430,20 @@ namespace Lua {
       return *(std::shared_ptr<TChildObject>*)ud->data;
     }
 
+    /**
+     * @brief borrow child object from stack without touching its reference
+     *  count, valid while the userdata stays on the stack
+     * @param state - lua state
+     * @param position - lua stack position holding value
+     * @return pointer to TChildObject
+     */
+    static TChildObject* Borrow(lua_State *state, int position = 1)
+    {
+      LUA->CheckType(position, TType);
+      UserData *ud = (UserData*)LUA->GetUserdata(position);
+      return ((std::shared_ptr<TChildObject>*)ud->data)->get();
+    }
+
     /**
      * @brief create LuaObject with supplied parameters
      * @param args - var args
@@ -122,52 +459,84 @@ namespace Lua {
     {
       // Manual pop child shared_ptr
       LUA->CheckType(1, TType);
-      UserData* obj_data = (UserData*)LUA->GetUserdata(1);
-      std::shared_ptr<TChildObject> *obj_ptr = (std::shared_ptr<TChildObject>*)obj_data->data;
-      std::shared_ptr<TChildObject> obj = *obj_ptr;
+      Handle *handle = (Handle*)LUA->GetUserdata(1);
+      std::shared_ptr<TChildObject> obj = std::move(handle->ptr);
+
+      // A userdata pushed after Unreference still uses the object
+      auto reference = obj->findReference(state);
+      bool replaced = false;
 
-      obj->Destroy(state);
+      if (reference != obj->_references.end())
+      {
+        LUA->ReferencePush(reference->second);
+        replaced = !LUA->RawEqual(-1, 1);
+        LUA->Pop();
+      }
 
-      // Free reference
-      LUA->ReferenceFree(obj->_references[state]);
-      obj->_references.erase(state);
+      if (!replaced)
+      {
+        obj->Destroy(state);
+
+        // Free reference
+        reference = obj->findReference(state);
+        if (reference != obj->_references.end())
+        {
+          LUA->ReferenceFree(reference->second);
+          obj->_references.erase(reference);
+        }
+      }
 
-      // Release shared_ptr
-      delete obj_ptr;
+      // Destroy handle in place, lua frees the userdata block
+      handle->ptr.~shared_ptr();
 
       return 0;
     }
 
     static int __index(lua_State *state)
     {
-      auto obj = Pop(state, 1);
-      auto name = LuaValue::Pop(state, 2);
+      LUA->CheckType(1, TType);
 
       // Index getter/method members
-      if (name.type() == Type::STRING) {
-        auto method = obj->_methods.find(name);
-        auto getter = obj->_getters.find(name);
-
-        if (method != obj->_methods.end())
-          return LuaValue::Push(state, method->second);
-        if (getter != obj->_getters.end())
-          return getter->second(state);
+      if (LUA->IsType(2, Type::STRING)) {
+        unsigned int len = 0;
+        const char  *name = LUA->GetString(2, &len);
+
+        if (CFunc method = Class().FindMethod(name, len))
+          return LuaValue::Push(state, method);
+        if (CFunc getter = Class().FindGetter(name, len))
+          return getter(state);
       }
       
       return 0;
     }
 
+    static int __index_getter(lua_State *state)
+    {
+      LUA->CheckType(1, TType);
+
+      // Index getter members, methods were already resolved by the lua vm
+      if (LUA->IsType(2, Type::STRING)) {
+        unsigned int len = 0;
+        const char  *name = LUA->GetString(2, &len);
+
+        if (CFunc getter = Class().FindGetter(name, len))
+          return getter(state);
+      }
+
+      return 0;
+    }
+
     static int __newindex(lua_State *state)
     {
-      auto obj = Pop(state, 1);
-      auto name = LuaValue::Pop(state, 2);
+      LUA->CheckType(1, TType);
 
       // Index setter member
-      if (name.type() == Type::STRING) {
-        auto setter = obj->_setters.find(name);
+      if (LUA->IsType(2, Type::STRING)) {
+        unsigned int len = 0;
+        const char  *name = LUA->GetString(2, &len);
 
-        if (setter != obj->_setters.end())
-          return setter->second(state);
+        if (CFunc setter = Class().FindSetter(name, len))
+          return setter(state);
       }
 
       return 0;
@@ -175,7 +544,7 @@ namespace Lua {
 
     static int __tostring(lua_State *state)
     {
-      auto obj = Pop(state, 1);
+      auto obj = Borrow(state, 1);
 
       return LuaValue::Push(state, obj->name());
     }
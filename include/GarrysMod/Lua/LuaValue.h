@@ -1,11 +1,22 @@
 #ifndef _GLOO_LUA_VALUE_H_
 #define _GLOO_LUA_VALUE_H_
 
-#include <map>
+#include <stdexcept>
+#include <type_traits>
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <initializer_list>
+#include <new>
 #include <memory>
 #include <cassert>
+#include <limits>
+#include <cstring>
+#include <utility>
+#include <mutex>
+#include <unordered_map>
 #include <algorithm>
+#include "LuaArena.h"
 #include "GarrysMod/Lua/Interface.h"
 
 // C++ 17 std::variant pollyfill
@@ -15,53 +26,587 @@
 namespace GarrysMod {
 namespace Lua {
 
+  /**
+   * @brief borrowed, binary-safe string, not required to be NUL terminated
+   */
+  struct LuaStringView
+  {
+    const char *data;
+    size_t      size;
+
+    LuaStringView() : data(""), size(0) {}
+    LuaStringView(const char *data, size_t size) : data(data), size(size) {}
+    LuaStringView(const std::string &value) : data(value.data()), size(value.size()) {}
+
+    std::string str() const { return std::string(data, size); }
+
+    int compare(const LuaStringView &rhs) const
+    {
+      int result = std::memcmp(data, rhs.data, std::min(size, rhs.size));
+      if (result != 0) return result;
+      return size < rhs.size ? -1 : (size > rhs.size ? 1 : 0);
+    }
+
+    /**
+     * @brief 64-bit FNV-1a hash of the string bytes
+     */
+    uint64_t hash() const
+    {
+      uint64_t hash = 14695981039346656037ull;
+
+      for (size_t i = 0; i < size; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+
+      return hash;
+    }
+
+    bool operator==(const LuaStringView &rhs) const { return size == rhs.size && compare(rhs) == 0; }
+  }; // LuaStringView
+
+  /**
+   * @brief immutable string shared by every value interned from the same
+   *  LuaStringPool, the hash is computed once
+   */
+  struct LuaInternedString
+  {
+    std::string str;
+    uint64_t    hash;
+  }; // LuaInternedString
+
+  /**
+   * @brief bounds applied when converting lua tables to LuaValue
+   */
+  struct LuaPopLimits
+  {
+    size_t max_depth;   // deepest table nesting accepted
+    size_t max_entries; // total key/value pairs accepted across all tables
+
+    LuaPopLimits(size_t max_depth = 128, size_t max_entries = 1 << 22) :
+      max_depth(max_depth),
+      max_entries(max_entries) {}
+  }; // LuaPopLimits
+
+  class LuaValue;
+  class LuaValueRef;
+
+  /**
+   * @brief lua style table with a contiguous array part for keys 1..n and an
+   *  open-addressing hash part for every other key
+   *
+   * Sequences are stored the way lua stores them, appending key n + 1 grows
+   * the array part and pulls any following integer keys out of the hash part.
+   */
+  class LuaTable
+  {
+  public:
+    typedef std::pair<LuaValue, LuaValue> slot_t;
+
+    template<typename TTable, typename TValue>
+    class Iterator
+    {
+    public:
+      /**
+       * @brief key/value pair yielded by iteration, first refers to a key
+       *  owned by the iterator for array entries
+       */
+      struct Entry
+      {
+        const TValue &first;
+        TValue       &second;
+      };
+    private:
+      typedef typename std::remove_const<TValue>::type key_t;
+      typedef typename std::aligned_storage<sizeof(Entry), alignof(Entry)>::type entry_t;
+    private:
+      TTable          *_table;
+      size_t           _index;
+      mutable key_t    _key;
+      mutable entry_t  _entry;
+    public:
+      Iterator(TTable *table, size_t index);
+
+      Entry& operator*() const;
+      Entry* operator->() const { return &**this; }
+      Iterator& operator++();
+      bool operator==(const Iterator &rhs) const { return _index == rhs._index; }
+      bool operator!=(const Iterator &rhs) const { return _index != rhs._index; }
+    private:
+      void skipEmpty();
+    };
+
+    typedef Iterator<LuaTable, LuaValue>             iterator;
+    typedef Iterator<const LuaTable, const LuaValue> const_iterator;
+  private:
+    std::vector<LuaValue, LuaAllocator<LuaValue>> _array;
+    std::vector<slot_t, LuaAllocator<slot_t>>     _hash;
+    size_t                                        _hash_size;
+  public:
+    /**
+     * @brief number of entries
+     */
+    size_t size() const { return _array.size() + _hash_size; }
+    bool empty() const { return size() == 0; }
+
+    /**
+     * @brief number of entries stored in the array part, keys 1..n
+     */
+    size_t array_size() const { return _array.size(); }
+
+    /**
+     * @brief arena the table allocates from, nullptr for the heap
+     */
+    LuaArena* arena() const { return _array.get_allocator().arena(); }
+  public:
+    LuaTable() : _hash_size(0) {}
+    explicit LuaTable(LuaArena *arena) :
+      _array(LuaAllocator<LuaValue>(arena)),
+      _hash(LuaAllocator<slot_t>(arena)),
+      _hash_size(0) {}
+    LuaTable(std::initializer_list<slot_t> entries);
+  public:
+    /**
+     * @brief find value by key
+     * @param key - table key
+     * @return pointer to value or nullptr when absent
+     */
+    LuaValue* Find(const LuaValue &key);
+    const LuaValue* Find(const LuaValue &key) const;
+
+    /**
+     * @brief insert or assign entry
+     * @param key   - table key, must not be nil
+     * @param value - table value
+     * @return reference to stored value
+     */
+    LuaValue& Emplace(LuaValue key, LuaValue value);
+
+    /**
+     * @brief remove entry by key
+     * @param key - table key
+     * @return true if an entry was removed
+     */
+    bool Erase(const LuaValue &key);
+
+    /**
+     * @brief preallocate array and hash parts
+     * @param array_size - expected number of sequence entries
+     * @param hash_size  - expected number of other entries
+     */
+    void Reserve(size_t array_size, size_t hash_size);
+
+    void Clear();
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+  public:
+    LuaValue& operator[](const LuaValue &key);
+    bool operator==(const LuaTable &rhs) const;
+    bool operator!=(const LuaTable &rhs) const { return !(*this == rhs); }
+  private:
+    static bool arrayIndex(const LuaValue &key, size_t &index);
+    size_t findSlot(const LuaValue &key) const;
+    LuaValue& insertHash(LuaValue key, LuaValue value);
+    void rehash(size_t capacity);
+    void migrateArray();
+  }; // LuaTable
+
+  /**
+   * @brief pool of interned strings, equal strings interned from one pool
+   *  share storage and compare by pointer
+   *
+   * Strings are released when the last value using them is destroyed, values
+   * may outlive the pool.  A pool is safe to use from any thread.
+   */
+  class LuaStringPool
+  {
+  private:
+    struct ViewHash
+    {
+      size_t operator()(const LuaStringView &str) const { return (size_t)str.hash(); }
+    };
+
+    struct Entry
+    {
+      const LuaInternedString                 *node;
+      std::weak_ptr<const LuaInternedString>   ref;
+    };
+
+    struct Core
+    {
+      std::mutex                                            mtx;
+      std::unordered_map<LuaStringView, Entry, ViewHash>    strings;
+    };
+  private:
+    std::shared_ptr<Core> _core;
+  public:
+    /**
+     * @brief number of strings currently interned
+     */
+    size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(_core->mtx);
+      return _core->strings.size();
+    }
+  public:
+    LuaStringPool() : _core(std::make_shared<Core>()) {}
+
+    LuaStringPool(const LuaStringPool&) = delete;
+    LuaStringPool& operator= (const LuaStringPool&) = delete;
+  public:
+    /**
+     * @brief get interned string value
+     * @param str - string data
+     * @return string value sharing storage with equal interned strings
+     */
+    LuaValue Intern(LuaStringView str);
+
+    /**
+     * @brief process wide pool
+     */
+    static LuaStringPool& Global()
+    {
+      static LuaStringPool pool;
+      return pool;
+    }
+
+    /**
+     * @brief pool strings popped from lua on this thread are interned into,
+     *  nullptr to copy them
+     */
+    static LuaStringPool*& Current()
+    {
+      static thread_local LuaStringPool *current = nullptr;
+      return current;
+    }
+  }; // LuaStringPool
+
+  /**
+   * @brief makes pool the current string pool of this thread until destroyed
+   */
+  class LuaStringPoolScope
+  {
+  private:
+    LuaStringPool *_previous;
+  public:
+    explicit LuaStringPoolScope(LuaStringPool &pool) : _previous(LuaStringPool::Current())
+    {
+      LuaStringPool::Current() = &pool;
+    }
+
+    ~LuaStringPoolScope() { LuaStringPool::Current() = _previous; }
+
+    LuaStringPoolScope(const LuaStringPoolScope&) = delete;
+    LuaStringPoolScope& operator= (const LuaStringPoolScope&) = delete;
+  }; // LuaStringPoolScope
+
+  /**
+   * @brief registry reference to a lua table whose fields are read on demand
+   *  and cached, only valid on the thread owning the lua state and while the
+   *  lua state is open
+   */
+  class LuaLazyTable
+  {
+  private:
+    lua_State *_state;
+    int        _ref;
+    LuaTable   _cache;
+    bool       _complete;
+  public:
+    lua_State* state() const { return _state; }
+  public:
+    LuaLazyTable(lua_State *state, int position);
+    ~LuaLazyTable();
+
+    LuaLazyTable(const LuaLazyTable&) = delete;
+    LuaLazyTable& operator= (const LuaLazyTable&) = delete;
+  public:
+    /**
+     * @brief get field, reading it from lua the first time it is accessed,
+     *  nested tables are returned lazy as well
+     * @param key - table key
+     * @return copy of cached value, nil when absent
+     */
+    LuaValue Get(const LuaValue &key);
+
+    /**
+     * @brief read every field, nested tables included
+     * @return cached table
+     */
+    const LuaTable& Table();
+
+    /**
+     * @brief push referenced table to lua stack
+     * @param state - Lua state
+     */
+    void Push(lua_State *state) const;
+  }; // LuaLazyTable
+
   class LuaValue
   {
+    friend class LuaLazyTable;
+    friend class LuaValueRef;
   public:
     typedef bool                         bool_t;
-    typedef std::map<LuaValue, LuaValue> table_t;
+    typedef LuaTable                     table_t;
     typedef double                       number_t;
     typedef std::string                  string_t;
     typedef CFunc                        function_t;
     typedef void*                        userdata_t;
+    typedef LuaStringView                view_t;
+    typedef std::shared_ptr<LuaLazyTable> lazy_t;
+    typedef std::shared_ptr<table_t>     shared_table_t;
+    typedef std::shared_ptr<const LuaInternedString> interned_t;
     typedef mpark::variant<
       bool_t,
-      table_t,
+      shared_table_t,
       number_t,
       string_t,
       function_t,
-      userdata_t
+      userdata_t,
+      view_t,
+      lazy_t,
+      interned_t
     > value_t;
   private:
     int     _type;
+    // Set once Emplace handed out a reference into the table, copies then
+    // get their own node instead of sharing one the reference can reach
+    bool    _unshareable;
     value_t _value;
   public:
     int type() const { return _type; }
+
+    /**
+     * @brief check if value is a string borrowed from the lua stack
+     */
+    bool borrowed() const { return mpark::holds_alternative<view_t>(_value); }
+
+    /**
+     * @brief check if value is a string from a LuaStringPool
+     */
+    bool interned() const { return mpark::holds_alternative<interned_t>(_value); }
+
+    /**
+     * @brief check if value is a lazy table reading fields on demand
+     */
+    bool lazy() const { return mpark::holds_alternative<lazy_t>(_value); }
+
+    /**
+     * @brief read-only access to table without copying, tables are shared
+     *  between copies of a value until one of them is modified
+     */
+    const table_t& table() const
+    {
+      if (lazy())
+        return mpark::get<lazy_t>(_value)->Table();
+
+      return *mpark::get<shared_table_t>(_value);
+    }
+
+    /**
+     * @brief get string data without copying, owned or borrowed
+     */
+    view_t view() const
+    {
+      if (borrowed())
+        return mpark::get<view_t>(_value);
+      if (interned())
+        return view_t(mpark::get<interned_t>(_value)->str);
+
+      return view_t(mpark::get<string_t>(_value));
+    }
   public:
-    LuaValue() { _type = Type::NIL; }
+    LuaValue() { _type = Type::NIL; _unshareable = false; }
 
-    LuaValue(bool_t value) { _type = Type::BOOL; _value = value; }
-    LuaValue(table_t value) { _type = Type::TABLE; _value = value; }
-    LuaValue(number_t value) { _type = Type::NUMBER; _value = value; }
-    LuaValue(string_t value) { _type = Type::STRING; _value = value; }
-    LuaValue(function_t value) { _type = Type::FUNCTION; _value = value; }
-    LuaValue(userdata_t value) { _type = Type::USERDATA; _value = value; }
-    LuaValue(int type, userdata_t value) { _type = type; _value = value; }
+    // Alternatives are constructed in place rather than assigned over the
+    // default one, values are created once per parsed or popped entry
+    LuaValue(bool_t value) : _type(Type::BOOL), _unshareable(false), _value(value) {}
+    LuaValue(table_t value) : _type(Type::TABLE), _unshareable(false), _value(makeTable(std::move(value))) {}
+    LuaValue(number_t value) : _type(Type::NUMBER), _unshareable(false), _value(value) {}
+    LuaValue(string_t value) : _type(Type::STRING), _unshareable(false), _value(std::move(value)) {}
+    LuaValue(view_t value) : _type(Type::STRING), _unshareable(false), _value(value) {}
+    LuaValue(lazy_t value) { _type = Type::TABLE; _unshareable = false; _value = std::move(value); }
+    LuaValue(interned_t value) { _type = Type::STRING; _unshareable = false; _value = std::move(value); }
+    LuaValue(function_t value) { _type = Type::FUNCTION; _unshareable = false; _value = value; }
+    LuaValue(userdata_t value) { _type = Type::USERDATA; _unshareable = false; _value = value; }
+    LuaValue(int type, userdata_t value) { _type = type; _unshareable = false; _value = value; }
 
     LuaValue(const LuaValue &value) { Copy(value); }
+    LuaValue(LuaValue &&value) noexcept :
+      _type(value._type),
+      _unshareable(value._unshareable),
+      _value(std::move(value._value))
+    {
+      value._type = Type::NIL;
+      value._unshareable = false;
+    }
 
-    LuaValue(int value) { _type = Type::NUMBER; _value = (number_t)value; }
-    LuaValue(unsigned int value) { _type = Type::NUMBER; _value = (number_t)value; }
-    LuaValue(const char *value) { _type = Type::STRING; _value = std::string(value); }
+    LuaValue(int value) { _type = Type::NUMBER; _unshareable = false; _value = (number_t)value; }
+    LuaValue(unsigned int value) { _type = Type::NUMBER; _unshareable = false; _value = (number_t)value; }
+    LuaValue(const char *value) { _type = Type::STRING; _unshareable = false; _value = std::string(value); }
   public:
     /**
      * @brief copy lua value from that
      * @param that - Lua value
      */
     void Copy(const LuaValue &that)
+    {
+      if (this == &that)
+        return;
+
+      _type = that._type;
+      _unshareable = false;
+
+      // Sharing would let a reference handed out by that write to the copy
+      if (that._unshareable)
+        _value = detachTable(*mpark::get<shared_table_t>(that._value));
+      else
+        _value = that._value;
+    }
+
+    /**
+     * @brief move lua value from that, leaving that nil
+     * @param that - Lua value
+     */
+    void Move(LuaValue &that)
     {
       _type = that._type;
-      _value = that._value;
+      _unshareable = that._unshareable;
+      _value = std::move(that._value);
+      that._type = Type::NIL;
+      that._unshareable = false;
+    }
+
+    /**
+     * @brief insert or assign table entry without copying key or value, the
+     *  table is copied instead of shared by later copies of this value
+     * @param key   - table key
+     * @param value - table value
+     * @return reference to stored value
+     */
+    LuaValue& Emplace(LuaValue key, LuaValue value)
+    {
+      AssertType(Type::TABLE);
+
+      table_t &table = mutableTable();
+      _unshareable = true;
+
+      return table.Emplace(std::move(key), std::move(value));
+    }
+
+    /**
+     * @brief insert or assign table entry, unlike Emplace the table stays
+     *  shareable between copies
+     * @param key   - table key
+     * @param value - table value
+     */
+    void Set(LuaValue key, LuaValue value)
+    {
+      AssertType(Type::TABLE);
+      mutableTable().Emplace(std::move(key), std::move(value));
+    }
+
+    /**
+     * @brief read table field without modifying or materializing the table,
+     *  lazy tables read only this field from lua
+     * @param key - table key
+     * @return copy of the field, nil when absent
+     */
+    LuaValue Get(const LuaValue &key) const
+    {
+      AssertType(Type::TABLE);
+
+      if (lazy())
+        return mpark::get<lazy_t>(_value)->Get(key);
+
+      const LuaValue *value = mpark::get<shared_table_t>(_value)->Find(key);
+      return value ? *value : LuaValue();
+    }
+
+    /**
+     * @brief deep copy, every table node is allocated from the current
+     *  LuaArena (or the heap), used to keep a value past LuaArena::Release
+     * @return independent lua value
+     */
+    LuaValue Clone() const
+    {
+      if (_type != Type::TABLE)
+      {
+        LuaValue value(*this);
+        value.Own();
+        return value;
+      }
+
+      const table_t &source = table();
+      table_t        table(LuaArena::Current());
+
+      table.Reserve(source.array_size(), source.size() - source.array_size());
+
+      for (const auto &pair : source)
+        table.Emplace(pair.first.Clone(), pair.second.Clone());
+
+      return LuaValue(std::move(table));
+    }
+
+    /**
+     * @brief replace lazy table with a full copy of the lua table, after which
+     *  the value no longer references the lua state
+     */
+    void Materialize()
+    {
+      if (!lazy())
+        return;
+
+      _value = makeTable(mpark::get<lazy_t>(_value)->Table());
+    }
+
+    /**
+     * @brief hash value consistent with operator==, integral numbers hash
+     *  the same regardless of sign of zero
+     */
+    size_t Hash() const
+    {
+      uint64_t hash;
+
+      switch (_type)
+      {
+        case Type::NIL: hash = 0; break;
+        case Type::BOOL: hash = mpark::get<bool_t>(_value) ? 1 : 2; break;
+        case Type::TABLE: hash = table().size(); break;
+        case Type::NUMBER:
+        {
+          number_t number = mpark::get<number_t>(_value);
+
+          if (number >= -9.2e18 && number <= 9.2e18 && number == (number_t)(int64_t)number)
+            hash = (uint64_t)(int64_t)number;
+          else
+            std::memcpy(&hash, &number, sizeof(hash));
+          break;
+        }
+        case Type::STRING: hash = interned() ? mpark::get<interned_t>(_value)->hash : view().hash(); break;
+        case Type::FUNCTION: hash = (uint64_t)(uintptr_t)mpark::get<function_t>(_value); break;
+        default: hash = (uint64_t)(uintptr_t)mpark::get<userdata_t>(_value); break;
+      }
+
+      // Finalize so sequential integers and aligned pointers spread evenly
+      hash ^= (uint64_t)_type << 56;
+      hash ^= hash >> 33;
+      hash *= 0xff51afd7ed558ccdull;
+      hash ^= hash >> 33;
+
+      return (size_t)hash;
+    }
+
+    /**
+     * @brief copy borrowed string into owned storage so the value outlives
+     *  the lua stack slot it was popped from
+     */
+    void Own()
+    {
+      if (borrowed())
+        _value = mpark::get<view_t>(_value).str();
     }
 
     /**
@@ -84,11 +629,20 @@ namespace Lua {
       if (_type != Type::TABLE)
         throw new std::runtime_error("Unable to push type '" + std::string(LUA->GetTypeName(_type)) + "' as table");
 
+      // Lazy tables push the original lua table
+      if (lazy())
+      {
+        mpark::get<lazy_t>(_value)->Push(state);
+        return;
+      }
+
       // Create table
       LUA->CreateTable();
 
+      // Keys and values are pushed in array then hash order
+
       // Iterate over table value
-      for (const auto &pair : mpark::get<table_t>(_value))
+      for (const auto &pair : table())
       {
         // Push key and value to stack
         pair.first.Push(state);
@@ -110,7 +664,7 @@ namespace Lua {
         case Type::NIL: LUA->PushNil(); break;
         case Type::TABLE: PushTable(state); break;
         case Type::NUMBER: LUA->PushNumber(mpark::get<number_t>(_value)); break;
-        case Type::STRING: LUA->PushString(mpark::get<string_t>(_value).c_str()); break;
+        case Type::STRING: PushString(state, view()); break;
         case Type::BOOL: LUA->PushBool(mpark::get<bool_t>(_value)); break;
         case Type::FUNCTION: LUA->PushCFunction(mpark::get<function_t>(_value)); break;
         default:
@@ -127,6 +681,13 @@ namespace Lua {
       return *this;
     }
 
+    inline LuaValue& operator= (LuaValue&& rhs) noexcept
+    {
+      if (this != &rhs)
+        Move(rhs);
+      return *this;
+    }
+
     inline bool operator< (const LuaValue& rhs) const
     {
       if (_type != rhs._type) return _type < rhs._type;
@@ -136,7 +697,8 @@ namespace Lua {
         case Type::NIL: return false;
         case Type::BOOL: return mpark::get<bool_t>(_value) < mpark::get<bool_t>(rhs._value);
         case Type::NUMBER: return mpark::get<number_t>(_value) < mpark::get<number_t>(rhs._value);
-        case Type::STRING: return mpark::get<string_t>(_value) < mpark::get<string_t>(rhs._value);
+        case Type::TABLE: return compareTables(table(), rhs.table()) < 0;
+        case Type::STRING: return !sameString(rhs) && view().compare(rhs.view()) < 0;
         case Type::FUNCTION: return mpark::get<function_t>(_value) < mpark::get<function_t>(rhs._value);
         default: return mpark::get<userdata_t>(_value) < mpark::get<userdata_t>(rhs._value);
       }
@@ -153,19 +715,16 @@ namespace Lua {
       {
         case Type::NIL: return true;
         case Type::BOOL: return mpark::get<bool_t>(_value) == mpark::get<bool_t>(rhs._value);
-        case Type::TABLE: return mpark::get<table_t>(_value) == mpark::get<table_t>(rhs._value);
+        case Type::TABLE: return table() == rhs.table();
         case Type::NUMBER: return mpark::get<number_t>(_value) == mpark::get<number_t>(rhs._value);
-        case Type::STRING: return mpark::get<string_t>(_value) == mpark::get<string_t>(rhs._value);
+        case Type::STRING: return sameString(rhs) || view() == rhs.view();
         case Type::FUNCTION: return mpark::get<function_t>(_value) == mpark::get<function_t>(rhs._value);
         default: return mpark::get<userdata_t>(_value) == mpark::get<userdata_t>(rhs._value);
       }
     }
     inline bool operator!=(const LuaValue& rhs) const { return !(*this == rhs); }
-    inline LuaValue& operator[](LuaValue idx)
-    {
-      AssertType(Type::TABLE);
-      return mpark::get<table_t>(_value)[idx];
-    }
+    inline LuaValueRef operator[](LuaValue idx);
+    inline LuaValue operator[](const LuaValue &idx) const { return Get(idx); }
 
     template<typename T>
     inline LuaValue& operator= (T rhs) { return *this = LuaValue(rhs); }
@@ -183,68 +742,54 @@ namespace Lua {
     inline bool operator!=(T rhs) const { return *this != LuaValue(rhs); }
 
     operator const bool_t() const { return mpark::get<bool_t>(_value); }
-    operator const table_t() const { return mpark::get<table_t>(_value); }
+    operator const table_t() const { return table(); }
     operator const number_t() const { return mpark::get<number_t>(_value); }
-    operator const string_t() const { return mpark::get<string_t>(_value); }
+    operator const string_t() const
+    {
+      return mpark::holds_alternative<string_t>(_value) ? mpark::get<string_t>(_value) : view().str();
+    }
     operator const function_t() const { return mpark::get<function_t>(_value); }
     operator const userdata_t() const { return mpark::get<userdata_t>(_value); }
 
     operator int() const { return (int)mpark::get<number_t>(_value); }
   public:
     /**
-     * @brief pop lua table from stack
+     * @brief pop lua table from stack, nested tables are converted without
+     *  recursion and any cycle raises an error
      * @param state    - Lua state
      * @param position - Lua stack position
+     * @param limits   - depth and size limits
      * @return new lua table value
+     * @throw std::runtime_error
      */
-    static inline LuaValue PopTable(lua_State *state, int position = 1)
+    static inline LuaValue PopTable(lua_State *state, int position = 1, const LuaPopLimits &limits = LuaPopLimits())
     {
-      int     table_ref;
-      auto    table_value = LuaValue(table_t());
-      int     type = LUA->GetType(position);
+      int type = LUA->GetType(position);
 
       if (type != Type::TABLE)
         throw std::runtime_error("Unable to pop type '" + std::string(LUA->GetTypeName(type)) + "' as table");
 
-      // Create table ref and push ref to stack
-      LUA->Push(position);
-      table_ref = LUA->ReferenceCreate();
-      LUA->ReferencePush(table_ref);
-      // Push nil as first key
-      LUA->PushNil();
-
-      // Increment lua iterator
-      while (LUA->Next(-2))
-      {
-        LuaValue key;
-        LuaValue value;
-
-        // Push key and table ref
-        LUA->Push(-2);
-        LUA->ReferencePush(table_ref);
-
-        // Ensure key is not equal to table ref
-        if (LUA->Equal(-1, -2))
-          throw std::runtime_error("Unable to pop table with cyclic reference");
-        else
-          key = LuaValue::Pop(state, -2);
-
-        // Ensure value is not equal to table ref
-        if (LUA->Equal(-1, -3))
-          throw std::runtime_error("Unable to pop table with cyclic reference");
-        else
-          value = LuaValue::Pop(state, -3);
+      int      top = LUA->Top();
+      size_t   entries = 0;
+      LuaValue table_value = LuaValue(table_t(LuaArena::Current()));
 
-        // Store key/value pair
-        mpark::get<table_t>(table_value._value)[key] = value;
+      // Tables currently being converted, keyed by the tables themselves
+      LUA->CreateTable();
+      LUA->Push(position < 0 ? top + position + 1 : position);
 
-        // Pop key copy, table ref, and value
-        LUA->Pop(3);
+      try
+      {
+        popTables(state, table_value, top + 1, limits, entries, 0);
+      }
+      catch (...)
+      {
+        // Leave the stack as it was found
+        LUA->Pop(LUA->Top() - top);
+        throw;
       }
 
-      // Pop table and free table ref
+      // Pop path table
       LUA->Pop();
-      LUA->ReferenceFree(table_ref);
 
       return table_value;
     }
@@ -253,9 +798,10 @@ namespace Lua {
      * @brief pop lua value from stack
      * @param state    - Lua state
      * @param position - Lua stack position
+     * @param limits   - depth and size limits for tables
      * @returns new lua value
      */
-    static inline LuaValue Pop(lua_State *state, int position = 1)
+    static inline LuaValue Pop(lua_State *state, int position = 1, const LuaPopLimits &limits = LuaPopLimits())
     {
       int type = LUA->GetType(position);
 
@@ -266,11 +812,19 @@ namespace Lua {
         case Type::BOOL:
           return LuaValue(LUA->GetBool(position));
         case Type::TABLE:
-          return PopTable(state, position);
+          return PopTable(state, position, limits);
         case Type::NUMBER:
           return LuaValue(LUA->GetNumber(position));
         case Type::STRING:
-          return LuaValue(std::string(LUA->GetString(position)));
+        {
+          unsigned int len = 0;
+          const char  *str = LUA->GetString(position, &len);
+
+          if (LuaStringPool *pool = LuaStringPool::Current())
+            return pool->Intern(view_t(str, len));
+
+          return LuaValue(std::string(str, len));
+        }
         case Type::FUNCTION:
           return LuaValue(LUA->GetCFunction(position));
         case Type::USERDATA:
@@ -280,6 +834,53 @@ namespace Lua {
       return LuaValue();
     }
 
+    /**
+     * @brief pop lua value from stack, strings are borrowed instead of copied
+     *  and stay valid while the value remains on the lua stack
+     * @param state    - Lua state
+     * @param position - Lua stack position
+     * @returns new lua value
+     */
+    static inline LuaValue PopBorrowed(lua_State *state, int position = 1)
+    {
+      if (LUA->GetType(position) != Type::STRING)
+        return Pop(state, position);
+
+      unsigned int len = 0;
+      const char  *str = LUA->GetString(position, &len);
+
+      return LuaValue(view_t(str, len));
+    }
+
+    /**
+     * @brief pop lua value from stack, tables are referenced instead of copied
+     *  and their fields are read when first accessed
+     * @param state    - Lua state
+     * @param position - Lua stack position
+     * @returns new lua value
+     */
+    static inline LuaValue PopLazy(lua_State *state, int position = 1)
+    {
+      if (LUA->GetType(position) != Type::TABLE)
+        return Pop(state, position);
+
+      return LuaValue(std::make_shared<LuaLazyTable>(state, position));
+    }
+
+    /**
+     * @brief push binary-safe string to lua stack
+     * @param state - lua state
+     * @param value - string data
+     */
+    static inline void PushString(lua_State *state, view_t value)
+    {
+      // PushString treats a zero length as NUL terminated
+      if (value.size == 0)
+        LUA->PushString("");
+      else
+        LUA->PushString(value.data, (unsigned int)value.size);
+    }
+
     /**
      * @brief creates empty LuaValue
      * @param type - Lua type
@@ -296,6 +897,8 @@ namespace Lua {
           return LuaValue(table_t());
         case Type::NUMBER:
           return LuaValue(0.0);
+        case Type::STRING:
+          return LuaValue(string_t());
         case Type::FUNCTION:
           return LuaValue(__empty);
         case Type::USERDATA:
@@ -318,8 +921,622 @@ namespace Lua {
     }
   private:
     static int __empty(lua_State *state) { return 0; }
+
+    /**
+     * @brief both values are the same interned string
+     */
+    bool sameString(const LuaValue &rhs) const
+    {
+      return interned() && rhs.interned() && mpark::get<interned_t>(_value) == mpark::get<interned_t>(rhs._value);
+    }
+
+    /**
+     * @brief order tables by size, then by their entries sorted by key
+     */
+    static int compareTables(const table_t &lhs, const table_t &rhs)
+    {
+      if (&lhs == &rhs)
+        return 0;
+      if (lhs.size() != rhs.size())
+        return lhs.size() < rhs.size() ? -1 : 1;
+
+      std::vector<std::pair<LuaValue, const LuaValue*>> lhs_entries = sortedEntries(lhs);
+      std::vector<std::pair<LuaValue, const LuaValue*>> rhs_entries = sortedEntries(rhs);
+
+      for (size_t i = 0; i < lhs_entries.size(); i++)
+      {
+        if (lhs_entries[i].first < rhs_entries[i].first) return -1;
+        if (rhs_entries[i].first < lhs_entries[i].first) return 1;
+        if (*lhs_entries[i].second < *rhs_entries[i].second) return -1;
+        if (*rhs_entries[i].second < *lhs_entries[i].second) return 1;
+      }
+
+      return 0;
+    }
+
+    static std::vector<std::pair<LuaValue, const LuaValue*>> sortedEntries(const table_t &table)
+    {
+      std::vector<std::pair<LuaValue, const LuaValue*>> entries;
+
+      entries.reserve(table.size());
+      for (const auto &pair : table)
+        entries.emplace_back(pair.first, &pair.second);
+
+      std::sort(entries.begin(), entries.end(), [](const std::pair<LuaValue, const LuaValue*> &a, const std::pair<LuaValue, const LuaValue*> &b) {
+        return a.first < b.first;
+      });
+
+      return entries;
+    }
+
+    /**
+     * @brief allocate shared table node from the allocator of the table
+     */
+    static shared_table_t makeTable(table_t table)
+    {
+      return std::allocate_shared<table_t>(LuaAllocator<table_t>(table.arena()), std::move(table));
+    }
+
+    /**
+     * @brief copy table node onto the heap, copies may be modified on any
+     *  thread while an arena belongs to the thread that filled it
+     */
+    static shared_table_t detachTable(const table_t &source)
+    {
+      table_t table;
+      table = source;
+
+      return makeTable(std::move(table));
+    }
+
+    /**
+     * @brief table for modification, detached from other values sharing it
+     */
+    table_t& mutableTable()
+    {
+      Materialize();
+
+      auto &table = mpark::get<shared_table_t>(_value);
+
+      // Copy on write, nested tables are shared by the copy
+      if (table.use_count() > 1)
+        table = detachTable(*table);
+
+      return *table;
+    }
+
+    /**
+     * @brief convert table on top of the stack into root, popping it
+     *
+     * Each nested table occupies two stack slots (table and iteration key)
+     * instead of a registry reference and a C++ stack frame.  Tables on the
+     * current path are flagged in the path table so any cycle is detected.
+     */
+    static void popTables(lua_State *state, LuaValue &root, int path, const LuaPopLimits &limits, size_t &entries, size_t depth)
+    {
+      std::vector<table_t*> frames;
+
+      enterTable(state, root, path, limits, entries, depth);
+      frames.push_back(mpark::get<shared_table_t>(root._value).get());
+
+      while (!frames.empty())
+      {
+        // Stack: table, key
+        if (!LUA->Next(-2))
+        {
+          // Stack: table, remove it from the path
+          LUA->PushNil();
+          LUA->RawSet(path);
+          frames.pop_back();
+          continue;
+        }
+
+        // Stack: table, key, value
+        if (++entries > limits.max_entries)
+          throw std::runtime_error("Unable to pop table with more than " + std::to_string(limits.max_entries) + " entries");
+
+        LuaValue key;
+
+        if (LUA->GetType(-2) == Type::TABLE)
+        {
+          // Table keys are rare, convert them with their own traversal
+          key = LuaValue(table_t(LuaArena::Current()));
+          LUA->Push(-2);
+          popTables(state, key, path, limits, entries, depth + frames.size());
+        }
+        else
+          key = Pop(state, -2);
+
+        if (LUA->GetType(-1) != Type::TABLE)
+        {
+          frames.back()->Emplace(std::move(key), Pop(state, -1));
+          LUA->Pop();
+          continue;
+        }
+
+        // Descend, the parent is not modified until the child is complete
+        LuaValue &child = frames.back()->Emplace(std::move(key), LuaValue(table_t(LuaArena::Current())));
+
+        enterTable(state, child, path, limits, entries, depth + frames.size());
+        frames.push_back(mpark::get<shared_table_t>(child._value).get());
+      }
+    }
+
+    /**
+     * @brief mark table on top of the stack as visited and push first key
+     */
+    static void enterTable(lua_State *state, LuaValue &value, int path, const LuaPopLimits &limits, size_t entries, size_t depth)
+    {
+      if (depth >= limits.max_depth)
+        throw std::runtime_error("Unable to pop table nested deeper than " + std::to_string(limits.max_depth));
+
+      LUA->Push(-1);
+      LUA->RawGet(path);
+      bool cyclic = LUA->GetType(-1) != Type::NIL;
+      LUA->Pop();
+
+      if (cyclic)
+        throw std::runtime_error("Unable to pop table with cyclic reference");
+
+      LUA->Push(-1);
+      LUA->PushBool(true);
+      LUA->RawSet(path);
+
+      // Size array part from the sequence length, a border can be far past
+      // the entries of a sparse table so never reserve beyond the limit
+      size_t length = (size_t)std::max(LUA->ObjLen(-1), 0);
+      mpark::get<shared_table_t>(value._value)->Reserve(std::min(length, limits.max_entries - entries), 0);
+
+      // Push nil as first key
+      LUA->PushNil();
+    }
   }; // LuaValue
 
+  /**
+   * @brief table field returned by the non-const LuaValue::operator[]
+   *
+   * Assignments go through LuaValue::Set, copy on write happens when the
+   * field is written rather than when it is indexed, so the table stays
+   * shareable between copies.  Like an iterator it must not be kept across
+   * a copy or modification of the table it came from.
+   */
+  class LuaValueRef
+  {
+  private:
+    LuaValue &_table;
+    LuaValue  _key;
+  public:
+    LuaValueRef(LuaValue &table, LuaValue key) : _table(table), _key(std::move(key)) {}
+    LuaValueRef(const LuaValueRef&) = default;
+  public:
+    /**
+     * @brief current field value, nil when absent
+     */
+    const LuaValue& value() const
+    {
+      static const LuaValue nil;
+      const LuaValue *value = _table.table().Find(_key);
+
+      return value ? *value : nil;
+    }
+
+    int type() const { return value().type(); }
+    int Push(lua_State *state) const { return value().Push(state); }
+    LuaValue Get(const LuaValue &key) const { return value().Get(key); }
+    const LuaValue::table_t& table() const { return value().table(); }
+  public:
+    LuaValueRef& operator= (LuaValue rhs)
+    {
+      _table.Set(_key, std::move(rhs));
+      return *this;
+    }
+
+    LuaValueRef& operator= (const LuaValueRef &rhs) { return *this = LuaValue(rhs.value()); }
+
+    /**
+     * @brief nested field, this field is detached and must be a table
+     * @param key - table key
+     */
+    LuaValueRef operator[](LuaValue key)
+    {
+      _table.AssertType(Type::TABLE);
+      return LuaValueRef(_table.mutableTable()[_key], std::move(key));
+    }
+
+    operator const LuaValue&() const { return value(); }
+
+    template<typename T>
+    explicit operator T() const { return (T)value(); }
+
+    template<typename T>
+    bool operator==(const T &rhs) const { return value() == rhs; }
+    template<typename T>
+    bool operator!=(const T &rhs) const { return value() != rhs; }
+  }; // LuaValueRef
+
+  inline LuaValueRef LuaValue::operator[](LuaValue idx)
+  {
+    AssertType(Type::TABLE);
+    return LuaValueRef(*this, std::move(idx));
+  }
+
+  inline LuaValue LuaStringPool::Intern(LuaStringView str)
+  {
+    std::shared_ptr<Core>       core = _core;
+    std::lock_guard<std::mutex> lock(core->mtx);
+
+    auto iter = core->strings.find(str);
+
+    if (iter != core->strings.end())
+    {
+      if (auto ref = iter->second.ref.lock())
+        return LuaValue(ref);
+
+      // Expired but its deleter has not run yet, the key points into it
+      core->strings.erase(iter);
+    }
+
+    LuaInternedString *node = new LuaInternedString { str.str(), str.hash() };
+
+    // Remove the entry when the last value using the string is destroyed
+    std::shared_ptr<const LuaInternedString> ref(node, [core](const LuaInternedString *node) {
+      {
+        std::lock_guard<std::mutex> lock(core->mtx);
+        auto iter = core->strings.find(LuaStringView(node->str));
+
+        if (iter != core->strings.end() && iter->second.node == node)
+          core->strings.erase(iter);
+      }
+
+      delete node;
+    });
+
+    core->strings.emplace(LuaStringView(node->str), Entry { node, ref });
+
+    return LuaValue(std::move(ref));
+  }
+
+  inline LuaLazyTable::LuaLazyTable(lua_State *state, int position) :
+    _state(state),
+    _complete(false)
+  {
+    LUA->Push(position);
+    _ref = LUA->ReferenceCreate();
+  }
+
+  inline LuaLazyTable::~LuaLazyTable()
+  {
+    lua_State *state = _state;
+    LUA->ReferenceFree(_ref);
+  }
+
+  inline LuaValue LuaLazyTable::Get(const LuaValue &key)
+  {
+    if (const LuaValue *value = _cache.Find(key))
+      return *value;
+
+    if (_complete || key.type() == Type::NIL)
+      return LuaValue();
+
+    lua_State *state = _state;
+
+    // Push table and read the single field
+    LUA->ReferencePush(_ref);
+    key.Push(state);
+    LUA->RawGet(-2);
+
+    LuaValue value = LuaValue::PopLazy(state, -1);
+
+    // Absent fields are not cached, misses would grow the cache
+    if (value.type() != Type::NIL)
+      _cache.Emplace(key, value);
+
+    // Pop value and table
+    LUA->Pop(2);
+
+    return value;
+  }
+
+  inline const LuaTable& LuaLazyTable::Table()
+  {
+    if (_complete)
+      return _cache;
+
+    lua_State *state = _state;
+
+    LUA->ReferencePush(_ref);
+
+    try
+    {
+      LuaValue table = LuaValue::PopTable(state, -1);
+      _cache = std::move(*mpark::get<LuaValue::shared_table_t>(table._value));
+    }
+    catch (...)
+    {
+      LUA->Pop();
+      throw;
+    }
+
+    LUA->Pop();
+    _complete = true;
+
+    return _cache;
+  }
+
+  inline void LuaLazyTable::Push(lua_State *state) const
+  {
+    LUA->ReferencePush(_ref);
+  }
+
+  inline LuaTable::LuaTable(std::initializer_list<slot_t> entries) : _hash_size(0)
+  {
+    for (const auto &entry : entries)
+      Emplace(entry.first, entry.second);
+  }
+
+  inline bool LuaTable::arrayIndex(const LuaValue &key, size_t &index)
+  {
+    if (key.type() != Type::NUMBER)
+      return false;
+
+    LuaValue::number_t number = key;
+
+    // Bounded by size_t as well, converting a larger number is undefined
+    // where size_t is 32 bits
+    if (!(number >= 1 && number <= 9007199254740992.0 && number <= (LuaValue::number_t)std::numeric_limits<size_t>::max()))
+      return false;
+    if (number != (LuaValue::number_t)(size_t)number)
+      return false;
+
+    index = (size_t)number - 1;
+    return true;
+  }
+
+  inline size_t LuaTable::findSlot(const LuaValue &key) const
+  {
+    size_t mask = _hash.size() - 1;
+
+    for (size_t i = key.Hash() & mask;; i = (i + 1) & mask)
+    {
+      if (_hash[i].first.type() == Type::NIL || _hash[i].first == key)
+        return i;
+    }
+  }
+
+  inline LuaValue* LuaTable::Find(const LuaValue &key)
+  {
+    return const_cast<LuaValue*>(static_cast<const LuaTable*>(this)->Find(key));
+  }
+
+  inline const LuaValue* LuaTable::Find(const LuaValue &key) const
+  {
+    size_t index;
+
+    if (arrayIndex(key, index) && index < _array.size())
+      return &_array[index];
+
+    if (_hash_size == 0)
+      return nullptr;
+
+    const slot_t &slot = _hash[findSlot(key)];
+    return slot.first.type() == Type::NIL ? nullptr : &slot.second;
+  }
+
+  inline LuaValue& LuaTable::Emplace(LuaValue key, LuaValue value)
+  {
+    size_t index;
+
+    if (key.type() == Type::NIL)
+      throw std::runtime_error("Unable to use nil as table key");
+
+    if (arrayIndex(key, index))
+    {
+      // Existing array entry
+      if (index < _array.size())
+        return _array[index] = std::move(value);
+
+      // Append to array part, key n + 1 is never left in the hash part
+      if (index == _array.size())
+      {
+        _array.push_back(std::move(value));
+        migrateArray();
+
+        return _array[index];
+      }
+    }
+
+    return insertHash(std::move(key), std::move(value));
+  }
+
+  inline LuaValue& LuaTable::insertHash(LuaValue key, LuaValue value)
+  {
+    // Keep load factor at or below three quarters, growing before the probe
+    // lets a single probe both find an existing key and place a new one
+    if ((_hash_size + 1) * 4 > _hash.size() * 3)
+      rehash(std::max<size_t>(_hash.size() * 2, 4));
+
+    slot_t &slot = _hash[findSlot(key)];
+
+    if (slot.first.type() != Type::NIL)
+      return slot.second = std::move(value);
+
+    slot.first = std::move(key);
+    slot.second = std::move(value);
+    _hash_size++;
+
+    return slot.second;
+  }
+
+  inline void LuaTable::migrateArray()
+  {
+    while (_hash_size != 0)
+    {
+      LuaValue key((LuaValue::number_t)(_array.size() + 1));
+      slot_t  &slot = _hash[findSlot(key)];
+
+      if (slot.first.type() == Type::NIL)
+        break;
+
+      LuaValue value = std::move(slot.second);
+      Erase(key);
+      _array.push_back(std::move(value));
+    }
+  }
+
+  inline bool LuaTable::Erase(const LuaValue &key)
+  {
+    size_t index;
+
+    if (arrayIndex(key, index) && index < _array.size())
+    {
+      // Entries after the hole no longer form a sequence, move them to the hash part
+      for (size_t i = index + 1; i < _array.size(); i++)
+        insertHash(LuaValue((LuaValue::number_t)(i + 1)), std::move(_array[i]));
+
+      _array.resize(index);
+      return true;
+    }
+
+    if (_hash_size == 0)
+      return false;
+
+    size_t mask = _hash.size() - 1;
+    size_t hole = findSlot(key);
+
+    if (_hash[hole].first.type() == Type::NIL)
+      return false;
+
+    // Backward shift deletion keeps probe sequences intact without tombstones
+    for (size_t i = (hole + 1) & mask; _hash[i].first.type() != Type::NIL; i = (i + 1) & mask)
+    {
+      size_t home = _hash[i].first.Hash() & mask;
+
+      if (((i - home) & mask) >= ((i - hole) & mask))
+      {
+        _hash[hole] = std::move(_hash[i]);
+        hole = i;
+      }
+    }
+
+    _hash[hole].first = LuaValue();
+    _hash[hole].second = LuaValue();
+    _hash_size--;
+
+    return true;
+  }
+
+  inline void LuaTable::rehash(size_t capacity)
+  {
+    std::vector<slot_t, LuaAllocator<slot_t>> hash(capacity, slot_t(), _hash.get_allocator());
+    hash.swap(_hash);
+
+    for (auto &slot : hash)
+    {
+      if (slot.first.type() != Type::NIL)
+        _hash[findSlot(slot.first)] = std::move(slot);
+    }
+  }
+
+  inline void LuaTable::Reserve(size_t array_size, size_t hash_size)
+  {
+    _array.reserve(array_size);
+
+    size_t capacity = 4;
+    while (capacity * 3 < hash_size * 4)
+      capacity <<= 1;
+
+    if (capacity > _hash.size() && hash_size != 0)
+      rehash(capacity);
+  }
+
+  inline void LuaTable::Clear()
+  {
+    _array.clear();
+    _hash.clear();
+    _hash_size = 0;
+  }
+
+  inline LuaValue& LuaTable::operator[](const LuaValue &key)
+  {
+    if (LuaValue *value = Find(key))
+      return *value;
+
+    return Emplace(key, LuaValue());
+  }
+
+  inline bool LuaTable::operator==(const LuaTable &rhs) const
+  {
+    if (size() != rhs.size())
+      return false;
+
+    for (const auto &pair : *this)
+    {
+      const LuaValue *value = rhs.Find(pair.first);
+
+      if (!value || *value != pair.second)
+        return false;
+    }
+
+    return true;
+  }
+
+  inline LuaTable::iterator LuaTable::begin() { return iterator(this, 0); }
+  inline LuaTable::iterator LuaTable::end() { return iterator(this, _array.size() + _hash.size()); }
+  inline LuaTable::const_iterator LuaTable::begin() const { return const_iterator(this, 0); }
+  inline LuaTable::const_iterator LuaTable::end() const { return const_iterator(this, _array.size() + _hash.size()); }
+
+  template<typename TTable, typename TValue>
+  inline LuaTable::Iterator<TTable, TValue>::Iterator(TTable *table, size_t index) :
+    _table(table),
+    _index(index)
+  {
+    skipEmpty();
+  }
+
+  template<typename TTable, typename TValue>
+  inline typename LuaTable::Iterator<TTable, TValue>::Entry& LuaTable::Iterator<TTable, TValue>::operator*() const
+  {
+    size_t array_size = _table->_array.size();
+
+    // Entry holds references so it is rebuilt in place on every dereference
+    if (_index < array_size)
+    {
+      _key = key_t((LuaValue::number_t)(_index + 1));
+      return *new (&_entry) Entry { _key, _table->_array[_index] };
+    }
+
+    auto &slot = _table->_hash[_index - array_size];
+    return *new (&_entry) Entry { slot.first, slot.second };
+  }
+
+  template<typename TTable, typename TValue>
+  inline LuaTable::Iterator<TTable, TValue>& LuaTable::Iterator<TTable, TValue>::operator++()
+  {
+    _index++;
+    skipEmpty();
+    return *this;
+  }
+
+  template<typename TTable, typename TValue>
+  inline void LuaTable::Iterator<TTable, TValue>::skipEmpty()
+  {
+    size_t array_size = _table->_array.size();
+    size_t end = array_size + _table->_hash.size();
+
+    while (_index < end && _index >= array_size && _table->_hash[_index - array_size].first.type() == Type::NIL)
+      _index++;
+  }
+
 }} // GarrysMod::Lua
 
+namespace std {
+
+  template<>
+  struct hash<GarrysMod::Lua::LuaValue>
+  {
+    size_t operator()(const GarrysMod::Lua::LuaValue &value) const { return value.Hash(); }
+  };
+
+} // std
+
 #endif//_GLOO_LUA_VALUE_H_
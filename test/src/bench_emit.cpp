@@ -0,0 +1,178 @@
+#include "gloo_bench.h"
+
+#include <GarrysMod/Lua/LuaEvent.h>
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <thread>
+
+using namespace GarrysMod::Lua;
+using namespace gloo_bench;
+
+namespace {
+
+  const int producers = 4;
+  const int events_per_producer = 20000;
+
+  /**
+   * @brief listener standing in for a lua callback doing a little work
+   */
+  int slow_listener(lua_State *state)
+  {
+    auto start = clock::now();
+
+    while (micros(start) < 2)
+      ;
+
+    return 0;
+  }
+
+  class BenchEmitter
+    : public LuaEventEmitter<240, BenchEmitter>
+  {
+  public:
+    std::string name() override { return "BenchEmitter"; }
+  public:
+    BenchEmitter() : LuaEventEmitter(4096) {}
+  };
+
+  /**
+   * @brief the queue Emit used before the ring buffer, a deque behind a
+   *  mutex that Think held while running callbacks
+   */
+  class LockedQueue
+  {
+  private:
+    std::mutex                                     _mtx;
+    std::deque<std::pair<LuaEventId, LuaEventArgs>> _events;
+  public:
+    void Emit(LuaEventId id, double value)
+    {
+      std::unique_lock<std::mutex> lock(_mtx);
+
+      _events.emplace_back(id, LuaEventArgs());
+      _events.back().second.Append(value);
+    }
+
+    void Think(lua_State *state)
+    {
+      std::unique_lock<std::mutex> lock(_mtx);
+
+      for (int i = 0; i < 100 && !_events.empty(); i++)
+      {
+        LUA->PushCFunction(slow_listener);
+        _events.front().second.Push(state);
+        LUA->Call(1, 0);
+
+        _events.pop_front();
+      }
+    }
+  };
+
+  /**
+   * @brief run producers against emit while the lua thread keeps calling
+   *  think, returns every Emit latency in microseconds
+   */
+  template<typename E, typename T>
+  std::vector<double> contend(E emit, T think)
+  {
+    std::vector<std::vector<double>> latencies(producers);
+    std::vector<std::thread>         threads;
+    std::atomic<int>                 done(0);
+
+    for (int p = 0; p < producers; p++)
+    {
+      threads.emplace_back([&, p]()
+      {
+        latencies[p].reserve(events_per_producer);
+
+        for (int i = 0; i < events_per_producer; i++)
+        {
+          auto start = clock::now();
+          emit((double)i);
+          latencies[p].push_back(micros(start));
+        }
+
+        done++;
+      });
+    }
+
+    while (done < producers)
+      think();
+
+    for (auto &thread : threads)
+      thread.join();
+
+    std::vector<double> all;
+
+    for (auto &samples : latencies)
+      all.insert(all.end(), samples.begin(), samples.end());
+
+    return all;
+  }
+
+  void report(std::string &out, const char *label, std::vector<double> samples, size_t dropped)
+  {
+    line(out, "%-16s p50 %8.2f us  p99 %8.2f us  p99.9 %8.2f us  max %10.2f us  dropped %zu",
+      label,
+      percentile(samples, 0.5),
+      percentile(samples, 0.99),
+      percentile(samples, 0.999),
+      percentile(samples, 1.0),
+      dropped);
+  }
+
+} // namespace
+
+/**
+ * Producer latency of Emit while the lua thread dispatches events to a slow
+ * listener, against the mutex protected deque Emit used to push into
+ */
+int bench_emit(lua_State *state)
+{
+  std::string out;
+
+  line(out, "Emit latency, %d producers x %d events, 2 us per callback", producers, events_per_producer);
+
+  {
+    LockedQueue queue;
+    LuaEventId  id = "tick"_event;
+
+    auto samples = contend(
+      [&](double value) { queue.Emit(id, value); },
+      [&]() { queue.Think(state); });
+
+    report(out, "mutex + deque", std::move(samples), 0);
+  }
+
+  {
+    auto emitter = BenchEmitter::Make();
+    std::atomic<size_t> dropped(0);
+
+    // obj:on("tick", slow_listener)
+    emitter->Push(state);
+    LUA->GetField(-1, "on");
+    LUA->Push(-2);
+    LUA->PushString("tick");
+    LUA->PushCFunction(slow_listener);
+    LUA->Call(3, 1);
+    LUA->Pop(2);
+
+    auto samples = contend(
+      [&](double value)
+      {
+        if (emitter->Emit("tick"_event, value) == LuaEventStatus::DROPPED)
+          dropped++;
+      },
+      [&]() { LuaEventEmitterManager::Current(state).Think(state); });
+
+    report(out, "lock-free ring", std::move(samples), dropped.load());
+
+    // Let lua collect the emitter, every run would keep one alive otherwise
+    emitter->Unreference(state);
+  }
+
+  LUA->PushString(out.c_str());
+  return 1;
+}
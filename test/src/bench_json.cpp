@@ -0,0 +1,207 @@
+#include "gloo_bench.h"
+
+#include <GarrysMod/Lua/LuaJson.h>
+
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace GarrysMod::Lua;
+using namespace gloo_bench;
+
+namespace {
+
+  const int items = 20000;
+  const int rounds = 5;
+
+  /**
+   * @brief array of small objects, a few MB of typical API traffic
+   */
+  std::string makeDocument()
+  {
+    std::string json = "[";
+
+    for (int i = 0; i < items; i++)
+    {
+      if (i)
+        json += ',';
+
+      json += "{\"id\":" + std::to_string(i) +
+        ",\"name\":\"item " + std::to_string(i) + "\\n\\\"quoted\\\"\"" +
+        ",\"score\":" + std::to_string(i * 0.25) +
+        ",\"active\":" + (i % 2 ? "true" : "false") +
+        ",\"tags\":[\"alpha\",\"beta\",\"gamma\"]" +
+        ",\"owner\":{\"name\":\"someone\",\"level\":" + std::to_string(i % 100) + ",\"extra\":null}}";
+    }
+
+    return json + "]";
+  }
+
+  /**
+   * @brief straightforward recursive-descent parser, one character at a
+   *  time, used as the baseline
+   */
+  class NaiveParser
+  {
+  private:
+    const char *_pos;
+    const char *_end;
+  public:
+    NaiveParser(const std::string &json) : _pos(json.data()), _end(json.data() + json.size()) {}
+  public:
+    LuaValue Value()
+    {
+      skip();
+
+      if (_pos == _end)
+        throw std::runtime_error("Unexpected end of JSON");
+
+      switch (*_pos)
+      {
+        case '{': return object();
+        case '[': return array();
+        case '"': return LuaValue(string());
+        case 't': _pos += 4; return LuaValue(true);
+        case 'f': _pos += 5; return LuaValue(false);
+        case 'n': _pos += 4; return LuaValue();
+        default:
+        {
+          char *end;
+          double number = std::strtod(_pos, &end);
+
+          _pos = end;
+          return LuaValue(number);
+        }
+      }
+    }
+  private:
+    void skip()
+    {
+      while (_pos != _end && (*_pos == ' ' || *_pos == '\n' || *_pos == '\r' || *_pos == '\t'))
+        _pos++;
+    }
+
+    std::string string()
+    {
+      std::string value;
+
+      for (_pos++; *_pos != '"'; _pos++)
+      {
+        if (*_pos != '\\')
+        {
+          value += *_pos;
+          continue;
+        }
+
+        switch (*++_pos)
+        {
+          case 'n': value += '\n'; break;
+          case 't': value += '\t'; break;
+          case 'r': value += '\r'; break;
+          default: value += *_pos; break;
+        }
+      }
+
+      _pos++;
+      return value;
+    }
+
+    LuaValue array()
+    {
+      LuaTable table;
+      double   index = 1;
+
+      for (_pos++; skip(), *_pos != ']';)
+      {
+        table.Emplace(LuaValue(index++), Value());
+        skip();
+
+        if (*_pos == ',')
+          _pos++;
+      }
+
+      _pos++;
+      return LuaValue(std::move(table));
+    }
+
+    LuaValue object()
+    {
+      LuaTable table;
+
+      for (_pos++; skip(), *_pos != '}';)
+      {
+        std::string key = string();
+
+        skip();
+        _pos++;
+
+        table.Emplace(LuaValue(key), Value());
+        skip();
+
+        if (*_pos == ',')
+          _pos++;
+      }
+
+      _pos++;
+      return LuaValue(std::move(table));
+    }
+  };
+
+  template<typename F>
+  double best(F run)
+  {
+    double result = 0;
+
+    for (int round = 0; round < rounds; round++)
+    {
+      auto start = clock::now();
+      run();
+
+      double elapsed = micros(start);
+      if (!round || elapsed < result)
+        result = elapsed;
+    }
+
+    return result;
+  }
+
+  void report(std::string &out, const char *label, size_t bytes, double elapsed)
+  {
+    line(out, "%-22s %9.1f ms  %8.1f MB/s", label, elapsed / 1000, bytes / elapsed);
+  }
+
+} // namespace
+
+/**
+ * JSON throughput of LuaJson parsing into a LuaValue, with and without an
+ * arena, straight onto the lua stack and serializing, against a naive
+ * recursive-descent parser
+ */
+int bench_json(lua_State *state)
+{
+  std::string out;
+  std::string json = makeDocument();
+  LuaValue    parsed = LuaJson::Parse(json);
+
+  line(out, "JSON, %.2f MB document, best of %d", json.size() / 1e6, rounds);
+
+  report(out, "naive parse", json.size(), best([&]() { NaiveParser(json).Value(); }));
+  report(out, "LuaJson::Parse", json.size(), best([&]() { LuaJson::Parse(json); }));
+
+  LuaArena arena;
+  report(out, "LuaJson::Parse, arena", json.size(), best([&]()
+  {
+    {
+      LuaArenaScope scope(arena);
+      LuaJson::Parse(json);
+    }
+
+    arena.Release();
+  }));
+  report(out, "LuaJson::Push", json.size(), best([&]() { LuaJson::Push(state, json.data(), json.size()); LUA->Pop(); }));
+
+  size_t size = LuaJson::Stringify(parsed).size();
+  report(out, "LuaJson::Stringify", size, best([&]() { LuaJson::Stringify(parsed); }));
+
+  LUA->PushString(out.c_str());
+  return 1;
+}
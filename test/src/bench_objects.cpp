@@ -0,0 +1,96 @@
+#include "gloo_bench.h"
+
+#include <GarrysMod/Lua/LuaObject.h>
+
+using namespace GarrysMod::Lua;
+using namespace gloo_bench;
+
+namespace {
+
+  const int           objects = 20000;
+  const unsigned char object_type = 241;
+
+  class BenchObject
+    : public LuaObject<object_type, BenchObject>
+  {
+  public:
+    std::string name() override { return "BenchObject"; }
+  };
+
+  /**
+   * @brief push a userdata with a metatable built for it alone, the way
+   *  registerObject did before metatables were cached per class.  The
+   *  userdata holds no object so __gc is left out of its metatable.
+   * @return registry reference to the userdata
+   */
+  int pushUncached(lua_State *state)
+  {
+    UserData *ud = (UserData*)LUA->NewUserdata(sizeof(UserData));
+      ud->data = nullptr;
+      ud->type = object_type;
+
+    LUA->CreateTable();
+      for (const auto &metamethod : BenchObject::Class().metamethods())
+      {
+        if (metamethod.first == "__gc")
+          continue;
+
+        LUA->PushCFunction(metamethod.second);
+        LUA->SetField(-2, metamethod.first.c_str());
+      }
+    LUA->SetMetaTable(-2);
+
+    LUA->Push(-1);
+    return LUA->ReferenceCreate();
+  }
+
+} // namespace
+
+/**
+ * Objects created and pushed per second with the per class metatable cache,
+ * against building a metatable for every object.  Pushed objects stay in
+ * the registry like any other pushed object.
+ */
+int bench_objects(lua_State *state)
+{
+  std::string out;
+
+  line(out, "Object creation, %d objects", objects);
+
+  {
+    std::vector<int> references;
+    references.reserve(objects);
+
+    auto start = clock::now();
+
+    for (int i = 0; i < objects; i++)
+    {
+      auto obj = BenchObject::Make();
+
+      references.push_back(pushUncached(state));
+      LUA->Pop();
+    }
+
+    double elapsed = micros(start);
+    line(out, "%-18s %10.0f objects/s  %6.2f us/object", "metatable each", objects / elapsed * 1e6, elapsed / objects);
+
+    for (int reference : references)
+      LUA->ReferenceFree(reference);
+  }
+
+  {
+    auto start = clock::now();
+
+    for (int i = 0; i < objects; i++)
+    {
+      BenchObject::Make()->Push(state);
+      LUA->Pop();
+    }
+
+    double elapsed = micros(start);
+    line(out, "%-18s %10.0f objects/s  %6.2f us/object", "cached metatable", objects / elapsed * 1e6, elapsed / objects);
+  }
+
+  LUA->PushString(out.c_str());
+  return 1;
+}
@@ -0,0 +1,81 @@
+#include "gloo_bench.h"
+
+#include <GarrysMod/Lua/LuaValue.h>
+
+using namespace GarrysMod::Lua;
+using namespace gloo_bench;
+
+namespace {
+
+  const int rows = 1000;
+  const int fields = 10;
+  const int rounds = 20;
+
+  /**
+   * @brief push { { 1, ..., fields }, ... rows times }, rows * fields entries
+   */
+  void pushNested(lua_State *state)
+  {
+    LUA->CreateTable();
+
+    for (int row = 1; row <= rows; row++)
+    {
+      LUA->PushNumber(row);
+      LUA->CreateTable();
+
+      for (int field = 1; field <= fields; field++)
+      {
+        LUA->PushNumber(field);
+        LUA->PushNumber(row * field);
+        LUA->RawSet(-3);
+      }
+
+      LUA->RawSet(-3);
+    }
+  }
+
+} // namespace
+
+/**
+ * PopTable/Push round trip of a nested table and the cost of handing the
+ * popped value on by move against the deep copy every hand-off used to be
+ */
+int bench_values(lua_State *state)
+{
+  std::string out;
+  double      pop = 0, push = 0, moved = 0, copied = 0;
+
+  line(out, "LuaValue round trip, %d x %d entry nested table, %d rounds", rows, fields, rounds);
+
+  pushNested(state);
+
+  for (int round = 0; round < rounds; round++)
+  {
+    auto start = clock::now();
+    LuaValue value = LuaValue::PopTable(state, -1);
+    pop += micros(start);
+
+    start = clock::now();
+    value.Push(state);
+    push += micros(start);
+    LUA->Pop();
+
+    start = clock::now();
+    LuaValue copy = value.Clone();
+    copied += micros(start);
+
+    start = clock::now();
+    LuaValue target = std::move(copy);
+    moved += micros(start);
+  }
+
+  LUA->Pop();
+
+  line(out, "%-10s %10.1f us", "PopTable", pop / rounds);
+  line(out, "%-10s %10.1f us", "Push", push / rounds);
+  line(out, "%-10s %10.1f us", "deep copy", copied / rounds);
+  line(out, "%-10s %10.3f us", "move", moved / rounds);
+
+  LUA->PushString(out.c_str());
+  return 1;
+}
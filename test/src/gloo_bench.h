@@ -0,0 +1,64 @@
+#ifndef _GLOO_TEST_BENCH_H_
+#define _GLOO_TEST_BENCH_H_
+
+#include <GarrysMod/Lua/Interface.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+
+/**
+ * Benchmarks exposed to lua as gloo.bench.*, each one runs on the calling
+ * lua state and returns a report string, e.g. print(gloo.bench.emit())
+ */
+int bench_emit(lua_State *state);
+int bench_objects(lua_State *state);
+int bench_values(lua_State *state);
+int bench_json(lua_State *state);
+
+namespace gloo_bench {
+
+  typedef std::chrono::steady_clock clock;
+
+  /**
+   * @brief microseconds elapsed since start
+   */
+  inline double micros(clock::time_point start)
+  {
+    return std::chrono::duration<double, std::micro>(clock::now() - start).count();
+  }
+
+  /**
+   * @brief percentile of samples, reorders samples
+   * @param samples - measurements
+   * @param p       - percentile between 0 and 1
+   */
+  inline double percentile(std::vector<double> &samples, double p)
+  {
+    if (samples.empty())
+      return 0;
+
+    size_t index = std::min(samples.size() - 1, (size_t)(p * (double)samples.size()));
+
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+  }
+
+  /**
+   * @brief append one formatted report line
+   */
+  template<typename... Args>
+  void line(std::string &report, const char *format, Args... args)
+  {
+    char buffer[256];
+
+    std::snprintf(buffer, sizeof(buffer), format, args...);
+    report += buffer;
+    report += '\n';
+  }
+
+} // gloo_bench
+
+#endif//_GLOO_TEST_BENCH_H_
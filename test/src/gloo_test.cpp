@@ -3,6 +3,8 @@
 #include <GarrysMod/Lua/LuaObject.h>
 #include <GarrysMod/Lua/LuaEvent.h>
 
+#include "gloo_bench.h"
+
 #include <chrono>
 #include <thread>
 
@@ -22,15 +24,22 @@ class TestObject
     {
       _run = true;
       _thread = std::thread(&TestObject::thread_work, this);
-
-      AddGetter("member", get_member);
-      AddSetter("member", set_member);
     }
     ~TestObject()
     {
       _run = false;
       _thread.join();
     }
+  public:
+    static void Define(LuaObjectClass &cls)
+    {
+      LuaEventEmitter::Define(cls);
+
+      cls.native_methods(true);
+      cls.AddGetter("member", GLOO_GETTER(TestObject, member));
+      cls.AddSetter("member", GLOO_SETTER(TestObject, set_member));
+      cls.AddMethod("echo", GLOO_METHOD(TestObject, echo));
+    }
   public:
     void thread_work() 
     {
@@ -43,23 +52,13 @@ class TestObject
       }
     }
 
-    static int get_member(lua_State *state)
-    {
-      auto obj = Pop(state, 1);
-      
-      return LuaValue::Push(state, obj->_member);
-    }
-    static int set_member(lua_State *state)
-    {
-      auto obj = Pop(state, 1);
-      auto value = LuaValue::Pop(state, 2);
-
-      if (value.type() == Type::STRING)
-      {
-        obj->_member = value;
-      }
+    std::string member() const { return _member; }
+    void set_member(const std::string &value) { _member = value; }
 
-      return 0;
+    double echo(double number, const std::string &text)
+    {
+      Emit("echo", number, text);
+      return number;
     }
 }; // TestObject
 
@@ -73,6 +72,16 @@ GMOD_MODULE_OPEN() {
     LUA->CreateTable();
       LUA->PushCFunction(make_test_obj);
       LUA->SetField(-2, "make_test");
+      LUA->CreateTable();
+        LUA->PushCFunction(bench_emit);
+        LUA->SetField(-2, "emit");
+        LUA->PushCFunction(bench_objects);
+        LUA->SetField(-2, "objects");
+        LUA->PushCFunction(bench_values);
+        LUA->SetField(-2, "values");
+        LUA->PushCFunction(bench_json);
+        LUA->SetField(-2, "json");
+      LUA->SetField(-2, "bench");
     LUA->SetField(-2, "gloo");
   LUA->Pop();
 